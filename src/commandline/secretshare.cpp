@@ -2,6 +2,7 @@
 
 #include <cerrno>
 #include <cstdint>
+#include <limits>
 #include <print>
 #include <stdexcept>
 
@@ -26,6 +27,7 @@ int main(int argc, char *argv[]) {
   auto err = -ENOENT;
 
   try {
+    if (options.discover()) FileOperations::discoverShares(options);
     if ((fileErr = FileOperations::checkFiles(options, fsize)) != FileOperations::noErr) {
       std::string errStr;
       switch (fileErr) {
@@ -36,6 +38,7 @@ int main(int argc, char *argv[]) {
 
         case FileOperations::emptyFileErr: {
           errStr = "File has zero length";
+          break;
         }
 
         case FileOperations::fileUnreadableErr: {
@@ -48,14 +51,23 @@ int main(int argc, char *argv[]) {
           break;
         }
 
+        case FileOperations::badShareErr: {
+          errStr = "Share(s) damaged";
+          break;
+        }
+
         default: {
           errStr = "Unknown error";
           break;
         }
       }
 
+      if (fileErr != FileOperations::fileNotFoundErr) err = -EINVAL;
       throw std::invalid_argument(errStr);
+    }
+    if (options.offset() > fsize) {
       err = -EINVAL;
+      throw std::invalid_argument("Offset is past the end of the file");
     }
   } catch (std::invalid_argument &e) {
     std::println("!!! Error: {}\n", e.what());
@@ -63,10 +75,69 @@ int main(int argc, char *argv[]) {
     exit(err);
   }
 
-  if (options.mode()) {
-    SecretSHareOperations::splitFile(options.filename(), fsize, options.m(), options.k());
+  auto containers = FileOperations::containers(options);
+  // a container's chunks sit behind its 64-byte header and each other's checksums, off the blocks
+  // O_DIRECT transfers whole
+  if (containers && options.direct()) {
+    std::println("!!! Error: container shares can't be read with --direct\n");
+    exit(-EINVAL);
+  }
+
+  if (options.append()) {
+    SecretSHareOperations::splitFileAppend(options.filename(), options.sharePaths(), options.m(), options.k(),
+                                           options.follow());
+  } else if (options.refresh()) {
+    SecretSHareOperations::refreshShares(options.filename(), options.sharePaths(), options.m(), options.k());
+  } else if (!options.previous().empty()) {
+    SecretSHareOperations::updateShares(options.filename(), options.previous(), options.sharePaths(),
+                                        options.m(), options.k());
+  } else if (!options.derive().empty()) {
+    SecretSHareOperations::deriveShares(options.filename(), options.sharePaths(), options.m(),
+                                        options.shares(), options.derive(), options.threads(),
+                                        options.direct());
+  } else if (FileOperations::streaming(options)) {
+    if (options.mmap() || options.uring() || options.direct() || options.container() || containers ||
+        options.ranged()) {
+      std::println(stderr, "!!! Error: pipes and FIFOs take raw shares in the default streaming mode only\n");
+      exit(-EINVAL);
+    }
+    if (options.mode()) {
+      SecretSHareOperations::splitStream(options.filename(), options.sharePaths(), options.m(), options.k());
+    } else {
+      SecretSHareOperations::joinStream(options.filename(), options.sharePaths(), options.m(),
+                                        options.shares());
+    }
+  } else if (containers && (options.mmap() || options.uring())) {
+    std::println("!!! Error: container shares are only read in the default streaming mode\n");
+    exit(-EINVAL);
+  } else if (options.mode() && options.k() == 1 && !options.container()) {
+    SecretSHareOperations::splitFileCopies(options.filename(), options.sharePaths(), fsize, options.m());
+  } else if (!options.mode() && options.shares().size() == 1 && !containers && !options.ranged()) {
+    SecretSHareOperations::joinFileCopy(options.filename(), options.sharePaths(), fsize,
+                                        *options.shares().begin());
+  } else if (options.mmap()) {
+    if (options.mode()) {
+      SecretSHareOperations::splitFileMapped(options.filename(), options.sharePaths(), options.m(),
+                                             options.k(), options.hugePages());
+    } else {
+      SecretSHareOperations::joinFileMapped(options.filename(), options.sharePaths(), options.m(),
+                                            options.shares(), options.hugePages());
+    }
+  } else if (options.uring()) {
+    if (options.mode()) {
+      SecretSHareOperations::splitFileAsync(options.filename(), options.sharePaths(), fsize, options.m(),
+                                            options.k());
+    } else {
+      SecretSHareOperations::joinFileAsync(options.filename(), options.sharePaths(), fsize, options.m(),
+                                           options.shares());
+    }
+  } else if (options.mode()) {
+    SecretSHareOperations::splitFile(options.filename(), options.sharePaths(), fsize, options.m(),
+                                     options.k(), options.threads(), options.direct(), options.container());
   } else {
-    SecretSHareOperations::joinFile(options.filename(), fsize, options.m(), options.shares());
+    SecretSHareOperations::joinFile(options.filename(), options.sharePaths(), fsize, options.m(), options.k(),
+                                    options.shares(), options.threads(), options.direct(), options.offset(),
+                                    options.length().value_or(std::numeric_limits<std::uintmax_t>::max()));
   }
 
   return 0;
@@ -0,0 +1,38 @@
+#include <array>
+#include <memory_resource>
+#include <print>
+#include <span>
+#include <string>
+
+#include "arena.hpp"
+#include "secretshare.hpp"
+
+int main() {
+  constexpr std::size_t M = 5;
+  constexpr std::size_t K = 3;
+
+  // every buffer the scheme needs comes out of the arena; nothing is freed until reset()
+  SecretShare::Arena arena(64 * 1024);
+  SecretShare::Scheme s(M, K, &arena);
+
+  std::array<uint8_t, 26> secret;
+  for (auto i{0u}; i < secret.size(); i++) secret[i] = i + 'A';
+
+  for (auto round{0u}; round < 3; round++) {
+    // split into M arena-backed, 64-byte-aligned shares
+    auto shares = s.split(secret);
+
+    // join shares 1, 3 and 4 back together
+    std::array<std::span<const uint8_t>, K> picked{shares[0], shares[2], shares[3]};
+    std::array<uint8_t, K> points{1, 3, 4};
+    auto joined = s.join(picked, points, secret.size());
+
+    std::println("ROUND {}: {} (arena capacity {} bytes)", round, std::string(joined.begin(), joined.end()),
+                 arena.capacity());
+
+    // release everything from this round in one go; the memory is reused by the next
+    arena.reset();
+  }
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+#include <array>
+#include <chrono>
+#include <memory>
+#include <print>
+#include <span>
+#include <vector>
+
+#include "arena.hpp"
+#include "secretshare.hpp"
+
+int main() {
+  constexpr std::size_t M = 5;
+  constexpr std::size_t K = 3;
+  constexpr std::size_t KEYS = 200000;
+  constexpr std::size_t KEYLEN = 32;
+
+  // a batch of 32-byte keys, stored back to back
+  std::vector<uint8_t> keys(KEYS * KEYLEN);
+  for (auto i{0u}; i < keys.size(); i++) keys[i] = i * 31 + 7;
+
+  std::vector<std::span<const uint8_t>> secrets;
+  secrets.reserve(KEYS);
+  for (auto i{0u}; i < KEYS; i++) secrets.emplace_back(keys.data() + i * KEYLEN, KEYLEN);
+
+  // one split call per key
+  auto start = std::chrono::steady_clock::now();
+  {
+    std::vector<std::shared_ptr<uint8_t[]>> outputs;
+    for (auto &secret : secrets) {
+      SecretShare::Scheme s(M, K);
+      auto input = std::make_shared_for_overwrite<uint8_t[]>(KEYLEN);
+      std::copy(secret.begin(), secret.end(), input.get());
+      s.split(input, KEYLEN, outputs);
+    }
+  }
+  std::chrono::duration<double> loop = std::chrono::steady_clock::now() - start;
+
+  // the whole batch in one call, every buffer from an arena
+  SecretShare::Arena arena(KEYS * KEYLEN * (M + K + 1));
+  SecretShare::Scheme s(M, K, &arena);
+  std::array<std::span<uint8_t>, M> shares;
+  for (auto &share : shares) share = s.allocate(keys.size());
+
+  start = std::chrono::steady_clock::now();
+  s.splitBatch(secrets, shares);
+  std::chrono::duration<double> batch = std::chrono::steady_clock::now() - start;
+
+  // share i + 1 of key n lives at shares[i][n * KEYLEN]; join key 0 and the last key back
+  std::array<std::span<const uint8_t>, K> picked{shares[1], shares[2], shares[4]};
+  std::array<uint8_t, K> points{2, 3, 5};
+  std::vector<uint8_t> joined(keys.size());
+  std::vector<std::span<uint8_t>> out;
+  for (auto i{0u}; i < KEYS; i++) out.emplace_back(joined.data() + i * KEYLEN, KEYLEN);
+  s.joinBatch(picked, points, out);
+
+  std::println("per-call loop: {:.0f} keys/sec", KEYS / loop.count());
+  std::println("batch:         {:.0f} keys/sec ({:.1f}x)", KEYS / batch.count(), loop.count() / batch.count());
+  std::println("round trip {}", joined == keys ? "OK" : "FAILED");
+
+  return 0;
+}
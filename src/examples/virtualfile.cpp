@@ -0,0 +1,65 @@
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <print>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "reconstructingreader.hpp"
+#include "secretshare.hpp"
+
+int main() {
+  constexpr std::size_t M = 5;
+  constexpr std::size_t K = 3;
+  constexpr std::size_t LEN = 32 * 1024 * 1024 + 17;
+
+  std::vector<uint8_t> secret(LEN);
+  for (auto i{0u}; i < secret.size(); i++) secret[i] = i * 131 + (i >> 11);
+
+  // split into raw share files
+  auto dir = std::filesystem::temp_directory_path() / "virtualfile";
+  std::filesystem::create_directories(dir);
+  {
+    SecretShare::Scheme s(M, K);
+    std::vector<std::vector<uint8_t>> shares(M, std::vector<uint8_t>(LEN));
+    std::vector<std::span<uint8_t>> spans(shares.begin(), shares.end());
+    s.split(secret, spans);
+    for (auto i{0u}; i < M; i++)
+      std::ofstream(dir / std::format("share_{}", i + 1), std::ios::binary)
+          .write(reinterpret_cast<const char *>(shares[i].data()), LEN);
+  }
+
+  // read the secret straight from shares 1, 3 and 4, never writing it out
+  std::array<std::filesystem::path, K> paths{dir / "share_1", dir / "share_3", dir / "share_4"};
+  std::array<uint8_t, K> points{1, 3, 4};
+  SecretShare::FileOperations::ReconstructingReader reader(paths, points);
+
+  // a sequential scan, with readahead
+  auto start = std::chrono::steady_clock::now();
+  std::vector<uint8_t> scanned(LEN);
+  std::array<uint8_t, 4096> page;
+  for (std::size_t done = 0, n; (n = reader.read(page)); done += n)
+    std::copy_n(page.begin(), n, scanned.begin() + done);
+  std::chrono::duration<double> scan = std::chrono::steady_clock::now() - start;
+  std::println("sequential: {:.0f} MB/s, {} cache hits, {} misses", LEN / scan.count() / 1e6, reader.hits(),
+               reader.misses());
+
+  // small reads at random offsets, as a database would make
+  std::mt19937_64 rng(42);
+  auto ok = scanned == secret;
+  start = std::chrono::steady_clock::now();
+  for (auto i{0u}; i < 20000; i++) {
+    auto offset = rng() % LEN;
+    auto n = reader.pread(offset, page);
+    ok = ok && std::equal(page.begin(), page.begin() + n, secret.begin() + offset);
+  }
+  std::chrono::duration<double> random = std::chrono::steady_clock::now() - start;
+  std::println("random 4K:  {:.0f} reads/s, {} cache hits, {} misses", 20000 / random.count(), reader.hits(),
+               reader.misses());
+  std::println("reads {}", ok ? "OK" : "FAILED");
+
+  std::filesystem::remove_all(dir);
+  return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef ARENA_HPP__
+#define ARENA_HPP__
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace SecretShare {
+  // A bump allocator handing out 64-byte-aligned blocks. Deallocation is a no-op; everything is
+  // reclaimed at once by reset(). After the first reset the arena holds a single block large enough
+  // for the previous cycle, so a steady-state workload never touches the upstream resource again.
+  class Arena : public std::pmr::memory_resource {
+   public:
+    static constexpr std::size_t alignment = 64;
+
+    explicit Arena(std::size_t initialSize = 1 << 20,
+                   std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+        : upstream_(upstream), offset_(0), nextSize_(roundUp(initialSize ? initialSize : alignment)) {}
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena() override { release(); }
+
+    void reset() {
+      if (blocks_.size() > 1) {
+        std::size_t total = 0;
+        for (auto &b : blocks_) total += b.size;
+        release();
+        nextSize_ = total;
+        grow(total);
+      }
+      offset_ = 0;
+    }
+
+    std::size_t capacity() const {
+      std::size_t total = 0;
+      for (auto &b : blocks_) total += b.size;
+      return total;
+    }
+
+   private:
+    struct Block {
+      std::byte *data;
+      std::size_t size;
+    };
+
+    std::pmr::memory_resource *upstream_;
+    std::vector<Block> blocks_;
+    std::size_t offset_;
+    std::size_t nextSize_;
+
+    static constexpr std::size_t roundUp(std::size_t n, std::size_t a = alignment) {
+      return (n + a - 1) & ~(a - 1);
+    }
+
+    void grow(std::size_t bytes) {
+      auto size = roundUp(std::max(bytes, nextSize_));
+      blocks_.push_back({static_cast<std::byte *>(upstream_->allocate(size, alignment)), size});
+      nextSize_ = size * 2;
+      offset_ = 0;
+    }
+
+    void release() {
+      for (auto &b : blocks_) upstream_->deallocate(b.data, b.size, alignment);
+      blocks_.clear();
+      offset_ = 0;
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t align) override {
+      if (align < alignment) align = alignment;
+      if (blocks_.empty() || !fits(bytes, align)) grow(bytes + align);
+      auto base = reinterpret_cast<std::uintptr_t>(blocks_.back().data);
+      auto p = roundUp(base + offset_, align);
+      offset_ = roundUp(p - base + (bytes ? bytes : 1));
+      return reinterpret_cast<void *>(p);
+    }
+
+    bool fits(std::size_t bytes, std::size_t align) const {
+      auto base = reinterpret_cast<std::uintptr_t>(blocks_.back().data);
+      return roundUp(base + offset_, align) + bytes <= base + blocks_.back().size;
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+      return this == &other;
+    }
+  };
+};  // namespace SecretShare
+#endif
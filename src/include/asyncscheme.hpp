@@ -0,0 +1,203 @@
+#ifndef ASYNCSCHEME_HPP__
+#define ASYNCSCHEME_HPP__
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#if __has_include(<execution>)
+#include <execution>
+#endif
+
+#include "secretshare.hpp"
+
+namespace SecretShare::Async {
+  inline constexpr std::size_t defaultChunkSize = 1 << 20;
+
+  // The work of one split, cut into independent chunks that may run concurrently and in any order.
+  // Each chunk draws its random values from its own stream, numbered by the chunk, of a key drawn
+  // for the job, so no state is shared between chunks.
+  class SplitJob {
+   public:
+    SplitJob(Scheme &scheme, std::span<const uint8_t> input, std::span<const std::span<uint8_t>> outputs,
+             std::size_t chunkSize = defaultChunkSize)
+        : scheme_(scheme),
+          plan_(scheme.splitPlan()),
+          input_(input),
+          outputs_(outputs.begin(), outputs.end()),
+          chunkSize_(chunkSize ? chunkSize : defaultChunkSize) {
+      // the chunks run on other threads, where a short buffer would go unnoticed out of bounds
+      if (outputs_.size() != plan_.outputs())
+        throw std::invalid_argument("One buffer is needed for each share");
+      for (auto &o : outputs_)
+        if (o.size() < input_.size()) throw std::invalid_argument("Share buffer shorter than the input");
+      key_ = RandomSource::key();
+    }
+
+    std::size_t chunks() const { return (input_.size() + chunkSize_ - 1) / chunkSize_; }
+
+    void operator()(std::size_t chunk) const {
+      auto offset = chunk * chunkSize_;
+      auto len = std::min(chunkSize_, input_.size() - offset);
+      auto k = plan_.inputs();
+
+      RandomSource random(key_, chunk);
+      auto ranbuf = std::make_unique_for_overwrite<uint8_t[]>((k - 1) * len);
+      random.fill({ranbuf.get(), (k - 1) * len});
+
+      std::vector<std::span<const uint8_t>> inputs;
+      inputs.reserve(k);
+      inputs.push_back(input_.subspan(offset, len));
+      for (auto i{1u}; i < k; i++) inputs.emplace_back(ranbuf.get() + (i - 1) * len, len);
+
+      std::vector<std::span<uint8_t>> outputs;
+      outputs.reserve(outputs_.size());
+      for (auto &o : outputs_) outputs.push_back(o.subspan(offset, len));
+
+      scheme_.evaluate(plan_, inputs, outputs);
+    }
+
+   private:
+    Scheme &scheme_;
+    const Plan &plan_;
+    std::span<const uint8_t> input_;
+    std::vector<std::span<uint8_t>> outputs_;
+    std::size_t chunkSize_;
+    RandomSource::Key key_;
+  };
+
+  // The work of one join, cut into independent chunks
+  class JoinJob {
+   public:
+    JoinJob(Scheme &scheme, std::span<const std::span<const uint8_t>> inputs,
+            std::span<const uint8_t> inPoints, std::span<uint8_t> output,
+            std::size_t chunkSize = defaultChunkSize)
+        : scheme_(scheme),
+          plan_(scheme.joinPlan(inPoints)),
+          inputs_(inputs.begin(), inputs.end()),
+          output_(output),
+          chunkSize_(chunkSize ? chunkSize : defaultChunkSize) {
+      if (inputs_.size() != plan_.inputs()) throw std::invalid_argument("One point is needed for each share");
+      for (auto &in : inputs_)
+        if (in.size() < output_.size()) throw std::invalid_argument("Share shorter than the output");
+    }
+
+    std::size_t chunks() const { return (output_.size() + chunkSize_ - 1) / chunkSize_; }
+
+    void operator()(std::size_t chunk) const {
+      auto offset = chunk * chunkSize_;
+      auto len = std::min(chunkSize_, output_.size() - offset);
+
+      std::vector<std::span<const uint8_t>> inputs;
+      inputs.reserve(inputs_.size());
+      for (auto &in : inputs_) inputs.push_back(in.subspan(offset, len));
+
+      const std::array<std::span<uint8_t>, 1> outputs{output_.subspan(offset, len)};
+      scheme_.evaluate(plan_, inputs, outputs);
+    }
+
+   private:
+    Scheme &scheme_;
+    Plan plan_;
+    std::vector<std::span<const uint8_t>> inputs_;
+    std::span<uint8_t> output_;
+    std::size_t chunkSize_;
+  };
+
+  // Hands every chunk of a job to submit, which queues a task on whatever executor the caller
+  // runs (a thread pool's post, an event loop's defer, ...). The future completes when the last
+  // chunk finishes, carrying the first exception any chunk threw.
+  template <typename Job, typename Submit>
+    requires std::invocable<Submit &, std::function<void()>>
+  std::future<void> submitChunks(Submit &submit, std::shared_ptr<const Job> job) {
+    struct Completion {
+      std::promise<void> promise;
+      std::atomic<std::size_t> remaining;
+      std::exception_ptr error;
+      std::mutex errorMutex;
+    };
+
+    auto completion = std::make_shared<Completion>();
+    auto future = completion->promise.get_future();
+    auto chunks = job->chunks();
+
+    if (!chunks) {
+      completion->promise.set_value();
+      return future;
+    }
+
+    completion->remaining = chunks;
+    for (auto c{0uz}; c < chunks; c++) {
+      submit(std::function<void()>([job, completion, c]() {
+        try {
+          (*job)(c);
+        } catch (...) {
+          std::lock_guard lock(completion->errorMutex);
+          if (!completion->error) completion->error = std::current_exception();
+        }
+        if (--completion->remaining == 0) {
+          if (completion->error)
+            completion->promise.set_exception(completion->error);
+          else
+            completion->promise.set_value();
+        }
+      }));
+    }
+    return future;
+  }
+
+  // Split on a caller-supplied executor. The scheme, input and outputs must stay alive, and the
+  // scheme otherwise unused, until the future is ready.
+  template <typename Submit>
+    requires std::invocable<Submit &, std::function<void()>>
+  std::future<void> asyncSplit(Submit &&submit, Scheme &scheme, std::span<const uint8_t> input,
+                               std::span<const std::span<uint8_t>> outputs,
+                               std::size_t chunkSize = defaultChunkSize) {
+    return submitChunks(submit, std::make_shared<const SplitJob>(scheme, input, outputs, chunkSize));
+  }
+
+  template <typename Submit>
+    requires std::invocable<Submit &, std::function<void()>>
+  std::future<void> asyncJoin(Submit &&submit, Scheme &scheme,
+                              std::span<const std::span<const uint8_t>> inputs,
+                              std::span<const uint8_t> inPoints, std::span<uint8_t> output,
+                              std::size_t chunkSize = defaultChunkSize) {
+    return submitChunks(submit, std::make_shared<const JoinJob>(scheme, inputs, inPoints, output, chunkSize));
+  }
+
+#if defined(__cpp_lib_senders)
+  // Sender versions: the chunks become a bulk operation on the caller's scheduler, so a parallel
+  // scheduler spreads them over its threads and the result composes with other senders (reads of
+  // the input, writes of the shares) in the usual way
+  template <std::execution::scheduler Scheduler>
+  std::execution::sender auto asyncSplit(Scheduler scheduler, Scheme &scheme, std::span<const uint8_t> input,
+                                         std::span<const std::span<uint8_t>> outputs,
+                                         std::size_t chunkSize = defaultChunkSize) {
+    auto job = std::make_shared<const SplitJob>(scheme, input, outputs, chunkSize);
+    auto chunks = job->chunks();
+    return std::execution::schedule(std::move(scheduler)) |
+           std::execution::bulk(std::execution::par, chunks, [job](std::size_t c) { (*job)(c); });
+  }
+
+  template <std::execution::scheduler Scheduler>
+  std::execution::sender auto asyncJoin(Scheduler scheduler, Scheme &scheme,
+                                        std::span<const std::span<const uint8_t>> inputs,
+                                        std::span<const uint8_t> inPoints, std::span<uint8_t> output,
+                                        std::size_t chunkSize = defaultChunkSize) {
+    auto job = std::make_shared<const JoinJob>(scheme, inputs, inPoints, output, chunkSize);
+    auto chunks = job->chunks();
+    return std::execution::schedule(std::move(scheduler)) |
+           std::execution::bulk(std::execution::par, chunks, [job](std::size_t c) { (*job)(c); });
+  }
+#endif
+};  // namespace SecretShare::Async
+
+#endif
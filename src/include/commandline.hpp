@@ -1,15 +1,81 @@
 #ifndef COMMANDLINE_HPP__
 #define COMMANDLINE_HPP__
+#include <getopt.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <filesystem>
 #include <format>
+#include <optional>
 #include <print>
 #include <set>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace SecretShare::CommandLine {
+  // Where the shares of a file live: either a template, in which {n} stands for the share number and
+  // {file} for the input file, or a comma-separated list of paths, one per share in order
+  class SharePaths {
+   public:
+    SharePaths() : template_("{file}_{n}.dat") {}
+    explicit SharePaths(const std::string& spec) {
+      if (spec.find("{n}") != std::string::npos) {
+        template_ = spec;
+        return;
+      }
+
+      std::stringstream specStr(spec);
+      std::string path;
+      while (std::getline(specStr, path, ','))
+        if (!path.empty()) list_.push_back(path);
+    }
+    // one path per share in order, empty for shares that are not there
+    explicit SharePaths(std::vector<std::string> list) : list_(std::move(list)) {}
+
+    // the number of paths in an explicit list, zero for a template
+    std::size_t listed() const { return list_.size(); }
+
+    std::filesystem::path path(const std::filesystem::path& file, uint n) const {
+      if (!list_.empty()) return list_.at(n - 1);
+
+      auto path = template_;
+      replace(path, "{file}", file.string());
+      replace(path, "{n}", std::to_string(n));
+      return path;
+    }
+
+    // whether name is the file name the template gives some share of file: its {n} a share number.
+    // A list of paths is matched by the default template
+    bool matches(const std::filesystem::path& file, std::string_view name) const {
+      auto pattern = list_.empty() ? template_ : SharePaths().template_;
+      replace(pattern, "{file}", file.string());
+      pattern = std::filesystem::path(pattern).filename().string();
+
+      auto at = pattern.find("{n}");
+      if (at == std::string::npos) return name == pattern;
+      auto prefix = std::string_view(pattern).substr(0, at);
+      auto suffix = std::string_view(pattern).substr(at + 3);
+      if (name.size() <= prefix.size() + suffix.size()) return false;
+      if (!name.starts_with(prefix) || !name.ends_with(suffix)) return false;
+      auto number = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+      return std::ranges::all_of(number, [](char c) { return c >= '0' && c <= '9'; });
+    }
+
+   private:
+    std::string template_;
+    std::vector<std::string> list_;
+
+    static void replace(std::string& s, std::string_view from, const std::string& to) {
+      for (auto pos = s.find(from); pos != std::string::npos; pos = s.find(from, pos + to.size()))
+        s.replace(pos, from.size(), to);
+    }
+  };
+
   class CommandLineOptions {
    public:
     explicit CommandLineOptions() : parsed_(false), split_(true), m_(false), k_(false) {}
@@ -22,8 +88,26 @@ namespace SecretShare::CommandLine {
       int c;
       opterr = 0;
       bool hasShares = false;
+      bool hasOutput = false;
 
-      while ((c = getopt(argc, argv, "m:k:js:r:")) != -1) {
+      static const option longOptions[] = {{"mmap", no_argument, nullptr, 'M'},
+                                           {"hugepages", no_argument, nullptr, 'H'},
+                                           {"uring", no_argument, nullptr, 'U'},
+                                           {"threads", required_argument, nullptr, 't'},
+                                           {"direct", no_argument, nullptr, 'D'},
+                                           {"output", required_argument, nullptr, 'o'},
+                                           {"container", no_argument, nullptr, 'C'},
+                                           {"dir", required_argument, nullptr, 'd'},
+                                           {"offset", required_argument, nullptr, 'O'},
+                                           {"length", required_argument, nullptr, 'L'},
+                                           {"append", no_argument, nullptr, 'a'},
+                                           {"follow", no_argument, nullptr, 'f'},
+                                           {"update", required_argument, nullptr, 'u'},
+                                           {"refresh", no_argument, nullptr, 'R'},
+                                           {"derive", required_argument, nullptr, 'N'},
+                                           {nullptr, 0, nullptr, 0}};
+
+      while ((c = getopt_long(argc, argv, "m:k:js:r:MHUt:Do:Cd:O:L:afu:RN:", longOptions, nullptr)) != -1) {
         switch (c) {
           case 'm': {
             m_ = std::stoul(optarg);
@@ -52,21 +136,153 @@ namespace SecretShare::CommandLine {
             break;
           }
 
+          case 'M': {
+            mmap_ = true;
+            break;
+          }
+
+          case 'H': {
+            hugePages_ = true;
+            break;
+          }
+
+          case 'U': {
+            uring_ = true;
+            break;
+          }
+
+          case 't': {
+            threads_ = std::stoul(optarg);
+            break;
+          }
+
+          case 'D': {
+            direct_ = true;
+            break;
+          }
+
+          case 'o': {
+            hasOutput = true;
+            sharePaths_ = SharePaths(optarg);
+            break;
+          }
+
+          case 'C': {
+            container_ = true;
+            break;
+          }
+
+          case 'd': {
+            searchDirs_.push_back(optarg);
+            break;
+          }
+
+          case 'O': {
+            offset_ = std::stoull(optarg);
+            break;
+          }
+
+          case 'L': {
+            length_ = std::stoull(optarg);
+            break;
+          }
+
+          case 'a': {
+            append_ = true;
+            break;
+          }
+
+          case 'f': {
+            append_ = true;
+            follow_ = true;
+            break;
+          }
+
+          case 'u': {
+            previous_ = optarg;
+            break;
+          }
+
+          case 'R': {
+            refresh_ = true;
+            break;
+          }
+
+          case 'N': {
+            uint v;
+            std::stringstream pointStr(optarg);
+
+            while (pointStr >> v) {
+              derive_.insert(v);
+              if (pointStr.peek() == ',') pointStr.ignore();
+            }
+            if (derive_.empty()) throw std::invalid_argument("--derive needs the numbers of the new shares");
+            break;
+          }
+
           case '?': {
-            auto err = std::format("Invalid option '{}'", static_cast<char>(optopt));
+            auto err = optopt ? std::format("Invalid option '{}'", static_cast<char>(optopt))
+                              : std::format("Invalid option '{}'", argv[optind - 1]);
             throw std::invalid_argument(err);
             break;
           }
         }
       }
-      if (m_ < 1 || m_ > 255)
-        throw std::invalid_argument("Number of shares must be a number between 1 and 255");
-      if (k_ < 1 || k_ > m_)
-        throw std::invalid_argument("Threshold must be a number between 1 and the number of shares");
+      // a join without a list of shares finds them, and the scheme, from their container headers
+      discover_ = !split_ && !hasShares;
+      if (discover_) {
+        if (m_ > 255) throw std::invalid_argument("Number of shares must be a number between 1 and 255");
+        if (m_ && k_ > m_)
+          throw std::invalid_argument("Threshold must be a number between 1 and the number of shares");
+        if (sharePaths_.listed())
+          throw std::invalid_argument("-o lists the shares; to search by a template leave out -s");
+      } else {
+        if (m_ < 1 || m_ > 255)
+          throw std::invalid_argument("Number of shares must be a number between 1 and 255");
+        if (k_ < 1 || k_ > m_)
+          throw std::invalid_argument("Threshold must be a number between 1 and the number of shares");
+        if (!searchDirs_.empty())
+          throw std::invalid_argument("--dir searches for shares when -s is left out");
+      }
+      if (mmap_ && uring_) throw std::invalid_argument("--mmap and --uring are mutually exclusive");
+      if (threads_ && (mmap_ || uring_))
+        throw std::invalid_argument("--threads only applies to the default streaming mode");
+      if (sharePaths_.listed() && sharePaths_.listed() != m_)
+        throw std::invalid_argument("List of share paths must name every share");
+      if (container_ && !split_)
+        throw std::invalid_argument("--container is for split; join recognises containers itself");
+      if (container_ && (mmap_ || uring_))
+        throw std::invalid_argument("--container only applies to the default streaming mode");
+      if (direct_ && container_)
+        throw std::invalid_argument("--direct can't write containers, whose chunks are not block-aligned");
+      if (direct_ && (mmap_ || uring_))
+        throw std::invalid_argument("--direct only applies to the default streaming mode");
+      if (ranged() && split_) throw std::invalid_argument("--offset and --length are for join");
+      if (ranged() && (mmap_ || uring_))
+        throw std::invalid_argument("--offset and --length only apply to the default streaming mode");
+      if (append_ && !split_) throw std::invalid_argument("--append and --follow are for split");
+      if (append_ && (mmap_ || uring_ || direct_ || container_))
+        throw std::invalid_argument("--append and --follow write raw shares in the default mode only");
+      if (!previous_.empty() && !split_) throw std::invalid_argument("--update is for split");
+      if (!previous_.empty() && (mmap_ || uring_ || direct_ || container_ || append_))
+        throw std::invalid_argument("--update patches the shares it finds, in the default mode only");
+      if (refresh_ && !split_) throw std::invalid_argument("--refresh works on the shares; leave out -j");
+      if (refresh_ && (mmap_ || uring_ || direct_ || container_ || append_ || !previous_.empty()))
+        throw std::invalid_argument("--refresh rewrites the shares it finds, in the default mode only");
+      if (!derive_.empty() && (split_ || discover_))
+        throw std::invalid_argument("--derive makes new shares from those given by -j -s");
+      if (!derive_.empty() && (mmap_ || uring_ || ranged()))
+        throw std::invalid_argument("--derive only applies to the default streaming mode");
+      for (auto point : derive_) {
+        if (point < 1 || point > m_)
+          throw std::invalid_argument("Shares to derive must be numbered between 1 and the number of shares");
+        if (shares_.contains(point))
+          throw std::invalid_argument(std::format("Share {} is one of those to derive from", point));
+      }
+      if (hugePages_ && !mmap_) throw std::invalid_argument("--hugepages only applies with --mmap");
       if (split_ && hasShares) throw std::invalid_argument("List of shares invalid for split mode");
-      if (!split_ && !hasShares)
-        throw std::invalid_argument("List of shares must be supplied for split mode");
-      if (!split_ && shares_.size() < k_) throw std::invalid_argument("Not enough shares specified");
+      if (!split_ && !discover_ && shares_.size() < k_)
+        throw std::invalid_argument("Not enough shares specified");
 
       int argdiff;
 
@@ -75,6 +291,15 @@ namespace SecretShare::CommandLine {
       else
         throw std::invalid_argument(argdiff == 0 ? "Missing filename argument"
                                                  : "Too many non-option arguments");
+
+      // standard input or output: there is no file name to put the shares next to
+      if (filename_ == "-") {
+        if (append_ || !previous_.empty() || refresh_ || !derive_.empty())
+          throw std::invalid_argument("--append, --update, --refresh and --derive need a file name");
+        if (!hasOutput) throw std::invalid_argument("'-' needs -o to say where the shares are");
+        if (mmap_ || uring_ || direct_)
+          throw std::invalid_argument("'-' only works in the default streaming mode");
+      }
     }
 
     const auto m() const { return m_; }
@@ -82,6 +307,38 @@ namespace SecretShare::CommandLine {
     const auto& shares() const { return shares_; }
     const auto mode() const { return split_; }
     const auto& filename() const { return filename_; }
+    const auto mmap() const { return mmap_; }
+    const auto hugePages() const { return hugePages_; }
+    const auto uring() const { return uring_; }
+    const auto direct() const { return direct_; }
+    const auto& sharePaths() const { return sharePaths_; }
+    const auto container() const { return container_; }
+    const auto discover() const { return discover_; }
+    // the part of the secret to join: length bytes from offset, or everything from offset on
+    const auto offset() const { return offset_; }
+    const auto& length() const { return length_; }
+    bool ranged() const { return offset_ || length_; }
+    const auto append() const { return append_; }
+    const auto follow() const { return follow_; }
+    // the version of the file the shares were made from, when updating them to the current one
+    const auto& previous() const { return previous_; }
+    const auto refresh() const { return refresh_; }
+    // the numbers of new shares to compute from those listed with -s, rather than joining them
+    const auto& derive() const { return derive_; }
+    const auto& searchDirs() const { return searchDirs_; }
+    auto sharePath(uint n) const { return sharePaths_.path(filename_, n); }
+    // compute threads for the streaming pipeline, one per core unless told otherwise
+    const auto threads() const {
+      return threads_ ? threads_ : std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // the shares found by searching, and the scheme their headers give
+    void useShares(std::size_t m, std::size_t k, std::set<uint> shares, SharePaths paths) {
+      m_ = m;
+      k_ = k;
+      shares_ = std::move(shares);
+      sharePaths_ = std::move(paths);
+    }
 
     static void usage() {
       std::println("Usage (split): secretshare -m <shares> -k <threshold> <filename>");
@@ -89,6 +346,37 @@ namespace SecretShare::CommandLine {
       std::println("\ne.g.\nsecretshare -m 7 -k 4 plaintextfile \n -> plaintextfile_1.dat");
       std::println(" -> plaintextfile_2.dat\n -> ...\n -> plaintextfile_7.dat\n");
       std::println("secretshare -m 7 -k 4 -j -s \"2 4 5 7\" plaintextfile\n -> plaintextfile.out");
+      std::println("\nJoining more than k shares leaves out those that can't be read or fail their checksums");
+      std::println("and corrects up to (n - k) / 2 wrong raw shares in every byte, reporting any it can't.");
+      std::println("\nJoining container shares needs no -m, -k or -s: they are found by their headers");
+      std::println("among the files named plaintextfile_<n>.dat (or by -o) next to it or in --dir, e.g.");
+      std::println("secretshare -j -d /mnt/disk1 -d /mnt/disk2 plaintextfile");
+      std::println("\nA filename of - splits standard input, or joins to standard output, with the shares");
+      std::println("named by -o; shares may also be FIFOs or /dev/fd/N, e.g.");
+      std::println("pg_dump db | secretshare -m 3 -k 2 -o /backup/{{n}}/db.share -");
+      std::println("\nOptions:");
+      std::println("  -M, --mmap       map the input and share files instead of reading and writing them");
+      std::println("  -H, --hugepages  ask for transparent huge pages on the mappings (with --mmap)");
+      std::println("  -U, --uring      overlap reads, writes and computation with io_uring");
+      std::println("  -t, --threads N  compute threads for the streaming mode (default: one per core)");
+      std::println("  -D, --direct     bypass the page cache with O_DIRECT (streaming mode, not containers)");
+      std::println("  -o, --output P   where the shares go: a template with {{n}} for the share number");
+      std::println("                   and {{file}} for the input (default {{file}}_{{n}}.dat),");
+      std::println("                   or a comma-separated list of one path per share");
+      std::println("  -C, --container  write each share in a container with a header and per-chunk CRC-32C");
+      std::println("  -O, --offset N   join only the part of the file from byte N on ...");
+      std::println("  -L, --length N   ... and only N bytes of it, reading no more of the shares than that");
+      std::println("  -a, --append     split only what was added to the file since the last --append,");
+      std::println("                   adding it to the end of the shares");
+      std::println("  -f, --follow     --append, and keep appending as the file grows until it is rotated");
+      std::println("  -u, --update OLD patch the shares of OLD in place to be shares of the file, an edit");
+      std::println("                   of OLD of the same length; only the changed bytes are touched");
+      std::println("  -R, --refresh    re-randomise the shares of the file, which need not exist, without");
+      std::println("                   joining them; the old shares stop working with the new ones");
+      std::println("  -N, --derive L   with -j -s, compute the shares numbered in L from those listed,");
+      std::println("                   to replace lost ones or add more (raise -m); nothing is joined");
+      std::println("  -d, --dir D      where join searches for container shares when -s is left out");
+      std::println("                   (repeatable; default the directory of the file)");
     }
 
    private:
@@ -98,6 +386,22 @@ namespace SecretShare::CommandLine {
     std::size_t k_;
     std::set<uint> shares_;
     std::string filename_;
+    bool mmap_ = false;
+    bool hugePages_ = false;
+    bool uring_ = false;
+    unsigned threads_ = 0;
+    bool direct_ = false;
+    SharePaths sharePaths_;
+    bool container_ = false;
+    bool discover_ = false;
+    std::vector<std::string> searchDirs_;
+    std::uintmax_t offset_ = 0;
+    std::optional<std::uintmax_t> length_;
+    bool append_ = false;
+    bool follow_ = false;
+    std::string previous_;
+    bool refresh_ = false;
+    std::set<uint> derive_;
   };
 };  // namespace SecretShare::CommandLine
 
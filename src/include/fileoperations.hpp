@@ -1,22 +1,166 @@
 #ifndef FILEOPERATIONS_HPP__
 #define FILEOPERATIONS_HPP__
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cstdint>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <map>
+#include <optional>
+#include <print>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "commandline.hpp"
+#include "sharecontainer.hpp"
 using namespace SecretShare;
 
 namespace SecretShare::FileOperations {
   namespace fs = std::filesystem;
 
-  enum FileError { noErr, fileNotFoundErr, emptyFileErr, fileUnreadableErr, lengthMismatchErr };
+  enum FileError {
+    noErr,
+    fileNotFoundErr,
+    emptyFileErr,
+    fileUnreadableErr,
+    lengthMismatchErr,
+    badShareErr
+  };
+
+  // pipes, FIFOs and terminals have no size and can only be read once, so they are left unopened
+  static bool isStream(const fs::path &path) {
+    auto status = fs::status(path);
+    return fs::exists(status) && !fs::is_regular_file(status);
+  }
+
+  // whether the input, or any of the shares, is a stream rather than a file: standard input or
+  // output ("-"), a pipe, a FIFO, /dev/fd/N ...
+  static bool streaming(const CommandLine::CommandLineOptions &options) {
+    if (options.filename() == "-") return true;
+    if (options.mode()) {
+      if (isStream(options.filename())) return true;
+      for (auto ix{1u}; ix <= options.m(); ix++)
+        if (isStream(options.sharePath(ix))) return true;
+      return false;
+    }
+    for (auto i : options.shares())
+      if (isStream(options.sharePath(i))) return true;
+    return false;
+  }
+
+  // whether any of the shares to join is in a container; one that can't be read is for the join
+  // to leave out, or to fail on
+  static bool containers(const CommandLine::CommandLineOptions &options) {
+    if (options.mode()) return false;
+    for (auto i : options.shares()) {
+      auto path = options.sharePath(i);
+      try {
+        if (!isStream(path) && readShareHeader(path)) return true;
+      } catch (const std::system_error &) {
+        continue;
+      }
+    }
+    return false;
+  }
+
+  // whether a file is on a filesystem reached over the network, and so the slower place to read from
+  static bool isRemote(const fs::path &path) {
+    struct statfs st;
+    if (statfs(path.c_str(), &st) < 0) return false;
+    switch (static_cast<uint32_t>(st.f_type)) {
+      case 0x6969:      // NFS
+      case 0x517b:      // SMB
+      case 0xff534d42:  // CIFS
+      case 0xfe534d42:  // SMB2
+      case 0x65735546:  // FUSE: sshfs, s3fs ...
+      case 0x00c36400:  // Ceph
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Find the shares of a join from their container headers. Every regular file in the search
+  // directories named as the share template names the file's shares (file_<n>.dat unless -o gives
+  // one) is a candidate; those with a sound header are grouped by set id, and the one set with k or
+  // more shares gives the scheme. All of its shares are joined, so that damage to some is worked
+  // round; a share found on both a local disk and a network filesystem is read from the local one.
+  static void discoverShares(CommandLine::CommandLineOptions &options) {
+    struct Found {
+      ShareHeader header;
+      fs::path path;
+      bool remote;
+    };
+
+    auto file = fs::path(options.filename());
+    auto name = file.filename().string();
+    std::vector<fs::path> dirs(options.searchDirs().begin(), options.searchDirs().end());
+    if (dirs.empty()) dirs.push_back(file.has_parent_path() ? file.parent_path() : fs::path("."));
+
+    std::map<uint64_t, std::map<uint, Found>> sets;
+    for (auto &dir : dirs) {
+      std::error_code ec;
+      for (auto &entry : fs::directory_iterator(dir, ec)) {
+        auto candidate = entry.path().filename().string();
+        if (!entry.is_regular_file(ec) || !options.sharePaths().matches(file, candidate)) continue;
+        if (entry.file_size(ec) < ShareHeader::size) continue;
+
+        std::optional<ShareHeader> header;
+        try {
+          header = readShareHeader(entry.path());
+        } catch (const std::system_error &e) {
+          std::println("Skipping {}", e.what());
+          continue;
+        }
+        if (!header || (options.m() && header->m < options.m()) || (options.k() && header->k != options.k()))
+          continue;
+
+        Found found{*header, entry.path(), isRemote(entry.path())};
+        auto [it, added] = sets[header->setId].try_emplace(header->share, found);
+        if (!added && it->second.remote && !found.remote) it->second = found;
+      }
+      if (ec) throw std::invalid_argument(std::format("Can't search {}: {}", dir.string(), ec.message()));
+    }
+
+    std::vector<Found> chosen;
+    for (auto &[setId, shares] : sets) {
+      auto k = shares.begin()->second.header.k;
+      if (shares.size() < k) continue;
+      if (!chosen.empty())
+        throw std::invalid_argument(
+            std::format("Shares of {} from more than one split; pick them with -s", name));
+
+      for (auto &[share, found] : shares) chosen.push_back(found);
+    }
+    if (chosen.empty()) throw std::invalid_argument(std::format("Not enough shares of {} found", name));
+
+    // derived shares can have extended the split, so the largest m covers every share number
+    auto m = std::ranges::max(chosen, {}, [](const Found &found) { return found.header.m; }).header.m;
+    std::vector<std::string> paths(m);
+    std::set<uint> shares;
+    for (auto &found : chosen) {
+      paths[found.header.share - 1] = found.path.string();
+      shares.insert(found.header.share);
+    }
+    options.useShares(m, chosen.front().header.k, std::move(shares),
+                      CommandLine::SharePaths(std::move(paths)));
+  }
 
   static FileError checkFiles(const CommandLine::CommandLineOptions &options, std::uintmax_t &fsize) {
+    fsize = 0;
+    // a refresh reads only the shares, and checks them itself
+    if (options.refresh()) return noErr;
     if (options.mode()) {
+      if (options.filename() == "-") return noErr;
+
       auto filepath = fs::weakly_canonical(fs::absolute(options.filename()));
       if (!fs::exists(filepath)) return fileNotFoundErr;
+      if (isStream(filepath)) return access(filepath.c_str(), R_OK) ? fileUnreadableErr : noErr;
 
       {
         auto ifs = std::ifstream(filepath);
@@ -27,30 +171,55 @@ namespace SecretShare::FileOperations {
       return noErr;
     }
 
-    std::uintmax_t eachfsize = 0;
-
-    for (auto i : options.shares()) {
-      auto share = std::format("{}_{}.dat", options.filename(), i);
+    // With shares to spare, the streaming join leaves out those it can't use (openJoinShares says
+    // why), so here they only count against the k it needs; fsize is the length most shares have
+    auto spare = options.shares().size() > options.k() && !options.mmap() && !options.uring();
+    auto check = [&](uint i, std::uintmax_t &cursize) {
+      auto share = options.sharePath(i);
       auto filepath = fs::weakly_canonical(fs::absolute(share));
 
       if (!fs::exists(filepath)) {
         return fileNotFoundErr;
       }
 
+      if (isStream(filepath)) return access(filepath.c_str(), R_OK) ? fileUnreadableErr : noErr;
+
       {
         auto ifs = std::ifstream(filepath);
         if (!ifs.good()) return fileUnreadableErr;
       }
 
-      auto cursize = fs::file_size(filepath);
-      if (!cursize) return emptyFileErr;
-      if (!eachfsize) eachfsize = cursize;
-      if (eachfsize != cursize) {
-        return lengthMismatchErr;
+      // a container's length is that of the share inside it
+      try {
+        cursize = ShareFile(filepath, O_RDONLY).length();
+      } catch (const std::system_error &e) {
+        if (!spare) std::println("{}", e.what());
+        return badShareErr;
+      }
+      return cursize ? noErr : emptyFileErr;
+    };
+
+    std::map<std::uintmax_t, std::size_t> lengths;
+    std::size_t streams = 0;
+    auto err = noErr;
+    for (auto i : options.shares()) {
+      std::uintmax_t cursize = 0;
+      auto shareErr = check(i, cursize);
+      if (shareErr != noErr) {
+        if (!spare) return shareErr;
+        if (err == noErr) err = shareErr;
+      } else if (cursize) {
+        lengths[cursize]++;
+      } else {
+        streams++;
       }
     }
+    if (lengths.size() > 1 && !spare) return lengthMismatchErr;
 
-    fsize = eachfsize;
+    auto most = std::ranges::max_element(lengths, {}, [](auto &count) { return count.second; });
+    if (streams + (most == lengths.end() ? 0 : most->second) < options.k())
+      return err != noErr ? err : lengthMismatchErr;
+    fsize = most == lengths.end() ? 0 : most->first;
 
     return noErr;
   }
@@ -0,0 +1,506 @@
+#ifndef IOENGINE_HPP__
+#define IOENGINE_HPP__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace SecretShare::FileOperations {
+  // an owned file descriptor
+  class FileDescriptor {
+   public:
+    FileDescriptor() = default;
+    FileDescriptor(const std::filesystem::path &path, int flags, mode_t mode = 0644) {
+      fd_ = open(path.c_str(), flags | O_CLOEXEC, mode);
+      if (fd_ < 0)
+        throw std::system_error(errno, std::generic_category(), std::format("Can't open {}", path.string()));
+    }
+    // takes over a descriptor opened some other way (inotify_init1, socket ...)
+    explicit FileDescriptor(int fd) : fd_(fd) {}
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+    FileDescriptor(FileDescriptor &&other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+    FileDescriptor &operator=(FileDescriptor &&other) noexcept {
+      std::swap(fd_, other.fd_);
+      return *this;
+    }
+    ~FileDescriptor() {
+      if (fd_ >= 0) close(fd_);
+    }
+
+    int get() const { return fd_; }
+
+   private:
+    int fd_ = -1;
+  };
+
+  // positioned transfers that loop until all of the buffer is done
+  inline void readAt(int fd, std::span<uint8_t> buffer, uint64_t offset) {
+    for (std::size_t done = 0; done < buffer.size();) {
+      auto r = pread(fd, buffer.data() + done, buffer.size() - done, static_cast<off_t>(offset + done));
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        throw std::system_error(errno, std::generic_category(), "pread");
+      }
+      if (r == 0) throw std::system_error(EIO, std::generic_category(), "Unexpected end of file");
+      done += static_cast<std::size_t>(r);
+    }
+  }
+
+  inline void writeAt(int fd, std::span<const uint8_t> buffer, uint64_t offset) {
+    for (std::size_t done = 0; done < buffer.size();) {
+      auto r = pwrite(fd, buffer.data() + done, buffer.size() - done, static_cast<off_t>(offset + done));
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        throw std::system_error(errno, std::generic_category(), "pwrite");
+      }
+      done += static_cast<std::size_t>(r);
+    }
+  }
+
+  // Make dst a copy of the first len bytes of src (all of it, for a reflink) as cheaply as the
+  // filesystems allow: a reflink sharing src's blocks (btrfs, XFS), else an in-kernel
+  // copy_file_range, else a plain read / write loop
+  inline void copyFile(int src, int dst, uint64_t len) {
+    if (ioctl(dst, FICLONE, src) == 0) return;
+
+    uint64_t done = 0;
+    while (done < len) {
+      auto in = static_cast<off_t>(done), out = static_cast<off_t>(done);
+      auto r = copy_file_range(src, &in, dst, &out, len - done, 0);
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        // not between these two files: copy the rest by hand
+        if (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP) break;
+        throw std::system_error(errno, std::generic_category(), "copy_file_range");
+      }
+      if (r == 0) throw std::system_error(EIO, std::generic_category(), "Unexpected end of file");
+      done += static_cast<uint64_t>(r);
+    }
+
+    std::vector<uint8_t> buffer(std::min<uint64_t>(len - done, 1 << 20));
+    while (done < len) {
+      auto n = std::min<uint64_t>(buffer.size(), len - done);
+      readAt(src, {buffer.data(), n}, done);
+      writeAt(dst, {buffer.data(), n}, done);
+      done += n;
+    }
+  }
+
+  // make the entries of a directory (a file just created or renamed into it) durable
+  inline void syncDirectory(const std::filesystem::path &dir) {
+    FileDescriptor d(dir.empty() ? std::filesystem::path(".") : dir, O_RDONLY | O_DIRECTORY);
+    if (fsync(d.get()) < 0) throw std::system_error(errno, std::generic_category(), "fsync");
+  }
+
+  // sequential transfers, for pipes, FIFOs and terminals, which have no offsets. readFull stops
+  // short only at end of file and returns what it got
+  inline std::size_t readFull(int fd, std::span<uint8_t> buffer) {
+    std::size_t done = 0;
+    while (done < buffer.size()) {
+      auto r = ::read(fd, buffer.data() + done, buffer.size() - done);
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        throw std::system_error(errno, std::generic_category(), "read");
+      }
+      if (r == 0) break;
+      done += static_cast<std::size_t>(r);
+    }
+    return done;
+  }
+
+  inline void writeAll(int fd, std::span<const uint8_t> buffer) {
+    for (std::size_t done = 0; done < buffer.size();) {
+      auto r = ::write(fd, buffer.data() + done, buffer.size() - done);
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        throw std::system_error(errno, std::generic_category(), "write");
+      }
+      done += static_cast<std::size_t>(r);
+    }
+  }
+
+  // Anonymous pages straight from the kernel, unmapped on destruction
+  class Pages {
+   public:
+    Pages() = default;
+    explicit Pages(std::size_t size) : size_(size) {
+      if (!size) return;
+      auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap");
+      data_ = static_cast<uint8_t *>(p);
+    }
+    Pages(const Pages &) = delete;
+    Pages &operator=(const Pages &) = delete;
+    Pages(Pages &&other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+    Pages &operator=(Pages &&other) noexcept {
+      std::swap(data_, other.data_);
+      std::swap(size_, other.size_);
+      return *this;
+    }
+    ~Pages() {
+      if (data_) munmap(data_, size_);
+    }
+
+    std::span<uint8_t> data() const { return {data_, size_}; }
+
+   private:
+    uint8_t *data_ = nullptr;
+    std::size_t size_ = 0;
+  };
+
+  // Hand pages to a pipe with vmsplice. The pipe keeps references to the pages rather than a copy
+  // of them, which is why they are given away: the pages are unmapped here, and stay alive only
+  // for as long as the reader at the other end needs them. Returns false, having written nothing,
+  // if fd is not a pipe; the pages are left alone in that case.
+  inline bool giftToPipe(int fd, Pages &pages, std::size_t len) {
+    auto data = pages.data().first(len);
+    for (std::size_t done = 0; done < data.size();) {
+      iovec iov{data.data() + done, data.size() - done};
+      auto r = vmsplice(fd, &iov, 1, SPLICE_F_GIFT);
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        if (done == 0 && (errno == EBADF || errno == EINVAL)) return false;
+        throw std::system_error(errno, std::generic_category(), "vmsplice");
+      }
+      done += static_cast<std::size_t>(r);
+    }
+    pages = Pages();
+    return true;
+  }
+
+  // A file read and written with O_DIRECT, bypassing the page cache, for every transfer that is
+  // block-aligned in memory, in the file and in length. Anything else, typically the tail of the
+  // file, goes through a second, buffered descriptor. Where the filesystem refuses O_DIRECT, at open
+  // or on the first transfer, the file quietly stays buffered.
+  class DirectFile {
+   public:
+    static constexpr std::size_t alignment = 4096;
+
+    DirectFile() = default;
+    DirectFile(const std::filesystem::path &path, int flags, bool direct) : buffered_(path, flags) {
+      if (!direct) return;
+      direct_ = open(path.c_str(), (flags & O_ACCMODE) | O_DIRECT | O_CLOEXEC);
+      if (direct_ < 0) direct_ = -1;
+    }
+    DirectFile(const DirectFile &) = delete;
+    DirectFile &operator=(const DirectFile &) = delete;
+    DirectFile(DirectFile &&other) noexcept
+        : buffered_(std::move(other.buffered_)),
+          direct_(std::exchange(other.direct_, -1)),
+          refused_(other.refused_.load()) {}
+    DirectFile &operator=(DirectFile &&other) noexcept {
+      buffered_ = std::move(other.buffered_);
+      std::swap(direct_, other.direct_);
+      refused_ = other.refused_.load();
+      return *this;
+    }
+    ~DirectFile() {
+      if (direct_ >= 0) close(direct_);
+    }
+
+    bool direct() const { return direct_ >= 0 && !refused_; }
+
+    // the device the file is on
+    dev_t device() const { return stat().st_dev; }
+
+    uint64_t size() const { return static_cast<uint64_t>(stat().st_size); }
+
+    // a hint that this part of the file is wanted soon, so the kernel can start reading it now
+    void willNeed(uint64_t offset, uint64_t len) const {
+      posix_fadvise(buffered_.get(), static_cast<off_t>(offset), static_cast<off_t>(len),
+                    POSIX_FADV_WILLNEED);
+    }
+
+    void read(std::span<uint8_t> buffer, uint64_t offset) {
+      auto aligned = alignedLength(buffer.data(), buffer.size(), offset);
+      if (aligned && !transfer(buffer.first(aligned), offset, false)) aligned = 0;
+      if (aligned < buffer.size()) readAt(buffered_.get(), buffer.subspan(aligned), offset + aligned);
+    }
+
+    void write(std::span<const uint8_t> buffer, uint64_t offset) {
+      auto aligned = alignedLength(buffer.data(), buffer.size(), offset);
+      if (aligned && !transfer({const_cast<uint8_t *>(buffer.data()), aligned}, offset, true)) aligned = 0;
+      if (aligned < buffer.size()) writeAt(buffered_.get(), buffer.subspan(aligned), offset + aligned);
+    }
+
+    // everything written so far, on the disk
+    void sync() const {
+      if (fdatasync(buffered_.get()) < 0)
+        throw std::system_error(errno, std::generic_category(), "fdatasync");
+    }
+
+   private:
+    FileDescriptor buffered_;
+    int direct_ = -1;
+    std::atomic<bool> refused_ = false;
+
+    struct stat stat() const {
+      struct stat st;
+      if (fstat(buffered_.get(), &st) < 0) throw std::system_error(errno, std::generic_category(), "fstat");
+      return st;
+    }
+
+    std::size_t alignedLength(const uint8_t *data, std::size_t len, uint64_t offset) const {
+      if (!direct() || reinterpret_cast<std::uintptr_t>(data) % alignment || offset % alignment) return 0;
+      return len & ~(alignment - 1);
+    }
+
+    // false if the filesystem turned out not to do direct I/O after all
+    bool transfer(std::span<uint8_t> buffer, uint64_t offset, bool write) {
+      try {
+        if (write)
+          writeAt(direct_, buffer, offset);
+        else
+          readAt(direct_, buffer, offset);
+        return true;
+      } catch (const std::system_error &e) {
+        if (e.code().value() != EINVAL) throw;
+        refused_ = true;
+        return false;
+      }
+    }
+  };
+
+  // Positioned reads and writes queued now and completed later. Backed by an io_uring, talked to
+  // through the raw system calls so there is nothing extra to link; where a ring can't be set up
+  // (old kernel, seccomp, container policy) every request is done on the spot with pread/pwrite.
+  //
+  // Requests are only queued by read() and write(); submit() hands the queue to the kernel without
+  // waiting, and wait() submits whatever is left and blocks until everything has completed.
+  class IoEngine {
+   public:
+    explicit IoEngine(unsigned depth) {
+      io_uring_params params;
+      std::memset(&params, 0, sizeof(params));
+
+      auto entries = std::bit_ceil(std::max(depth, 8u));
+      ringFd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+      if (ringFd_ < 0) return;
+
+      if (!mapRings(params)) {
+        unmapRings();
+        close(ringFd_);
+        ringFd_ = -1;
+      }
+    }
+
+    IoEngine(const IoEngine &) = delete;
+    IoEngine &operator=(const IoEngine &) = delete;
+
+    ~IoEngine() {
+      if (ringFd_ >= 0) {
+        // never leave the kernel writing into buffers that are about to be freed
+        try {
+          wait();
+        } catch (...) {
+        }
+        unmapRings();
+        close(ringFd_);
+      }
+    }
+
+    bool async() const { return ringFd_ >= 0; }
+
+    // Pin buffers for the life of the engine so requests on them skip the per-request page mapping.
+    // Requests may still use other memory. Failure (typically RLIMIT_MEMLOCK) is not an error.
+    void registerBuffers(std::span<const std::span<uint8_t>> buffers) {
+      if (ringFd_ < 0) return;
+
+      std::vector<iovec> iovs;
+      for (auto &b : buffers) iovs.push_back({b.data(), b.size()});
+      if (syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_BUFFERS, iovs.data(), iovs.size()) == 0)
+        registered_.assign(buffers.begin(), buffers.end());
+    }
+
+    void read(int fd, std::span<uint8_t> buffer, uint64_t offset) {
+      queue(fd, buffer.data(), buffer.size(), offset, false);
+    }
+
+    void write(int fd, std::span<const uint8_t> buffer, uint64_t offset) {
+      queue(fd, const_cast<uint8_t *>(buffer.data()), buffer.size(), offset, true);
+    }
+
+    void submit() {
+      if (ringFd_ >= 0 && toSubmit_) enter(0, 0);
+    }
+
+    void wait() {
+      if (ringFd_ < 0) return;
+
+      while (inFlight_ || toSubmit_) {
+        enter(1, IORING_ENTER_GETEVENTS);
+        reap();
+      }
+      ops_.clear();
+    }
+
+   private:
+    struct Op {
+      int fd;
+      uint8_t *data;
+      std::size_t len;
+      uint64_t offset;
+      bool write;
+    };
+
+    int ringFd_ = -1;
+    void *sqRing_ = MAP_FAILED;
+    void *cqRing_ = MAP_FAILED;
+    io_uring_sqe *sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+    std::size_t sqRingSize_ = 0, cqRingSize_ = 0, sqesSize_ = 0;
+    unsigned *sqHead_, *sqTail_, *sqMask_, *sqArray_, sqEntries_ = 0;
+    unsigned *cqHead_, *cqTail_, *cqMask_;
+    io_uring_cqe *cqes_;
+    unsigned toSubmit_ = 0;
+    unsigned inFlight_ = 0;
+    std::vector<Op> ops_;
+    std::vector<std::span<uint8_t>> registered_;
+
+    bool mapRings(const io_uring_params &p) {
+      sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+      cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+      if (p.features & IORING_FEAT_SINGLE_MMAP)
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+      sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_,
+                     IORING_OFF_SQ_RING);
+      if (sqRing_ == MAP_FAILED) return false;
+
+      if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing_ = sqRing_;
+      } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_,
+                       IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) return false;
+      }
+
+      sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+      auto sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_,
+                       IORING_OFF_SQES);
+      if (sqes == MAP_FAILED) return false;
+      sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+      auto sq = static_cast<uint8_t *>(sqRing_);
+      sqHead_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+      sqTail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+      sqMask_ = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+      sqArray_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+      sqEntries_ = p.sq_entries;
+
+      auto cq = static_cast<uint8_t *>(cqRing_);
+      cqHead_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+      cqTail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+      cqMask_ = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+      cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+      return true;
+    }
+
+    void unmapRings() {
+      if (sqes_ != MAP_FAILED) munmap(sqes_, sqesSize_);
+      if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+      if (sqRing_ != MAP_FAILED) munmap(sqRing_, sqRingSize_);
+    }
+
+    int registeredIndex(const uint8_t *data, std::size_t len) const {
+      for (auto i{0u}; i < registered_.size(); i++)
+        if (data >= registered_[i].data() && data + len <= registered_[i].data() + registered_[i].size())
+          return static_cast<int>(i);
+      return -1;
+    }
+
+    void queue(int fd, uint8_t *data, std::size_t len, uint64_t offset, bool write) {
+      if (ringFd_ < 0) {
+        transfer({fd, data, len, offset, write}, 0);
+        return;
+      }
+
+      // a full submission ring has to drain before it takes more
+      if (inFlight_ + toSubmit_ >= sqEntries_) {
+        enter(1, IORING_ENTER_GETEVENTS);
+        reap();
+      }
+
+      auto tail = *sqTail_;
+      auto index = tail & *sqMask_;
+      auto sqe = &sqes_[index];
+      std::memset(sqe, 0, sizeof(*sqe));
+
+      auto buffer = registeredIndex(data, len);
+      if (buffer >= 0) {
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = static_cast<uint16_t>(buffer);
+      } else {
+        sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+      }
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(data);
+      sqe->len = static_cast<uint32_t>(len);
+      sqe->off = offset;
+      sqe->user_data = ops_.size();
+      ops_.push_back({fd, data, len, offset, write});
+
+      sqArray_[index] = index;
+      std::atomic_ref<unsigned>(*sqTail_).store(tail + 1, std::memory_order_release);
+      toSubmit_++;
+    }
+
+    void enter(unsigned minComplete, unsigned flags) {
+      for (;;) {
+        auto r = syscall(__NR_io_uring_enter, ringFd_, toSubmit_, minComplete, flags, nullptr, 0);
+        if (r >= 0) {
+          toSubmit_ -= static_cast<unsigned>(r);
+          inFlight_ += static_cast<unsigned>(r);
+          return;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+          throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+        if (errno != EINTR) reap();
+      }
+    }
+
+    void reap() {
+      auto head = *cqHead_;
+      auto tail = std::atomic_ref<unsigned>(*cqTail_).load(std::memory_order_acquire);
+
+      for (; head != tail; head++) {
+        auto &cqe = cqes_[head & *cqMask_];
+        auto &op = ops_[cqe.user_data];
+        auto res = cqe.res;
+        inFlight_--;
+        std::atomic_ref<unsigned>(*cqHead_).store(head + 1, std::memory_order_release);
+
+        if (res < 0) throw std::system_error(-res, std::generic_category(), op.write ? "write" : "read");
+        // a short transfer is finished off synchronously
+        if (static_cast<std::size_t>(res) < op.len) transfer(op, static_cast<std::size_t>(res));
+      }
+    }
+
+    static void transfer(const Op &op, std::size_t done) {
+      if (op.write)
+        writeAt(op.fd, {op.data + done, op.len - done}, op.offset + done);
+      else
+        readAt(op.fd, {op.data + done, op.len - done}, op.offset + done);
+    }
+  };
+};  // namespace SecretShare::FileOperations
+#endif
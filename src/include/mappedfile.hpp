@@ -0,0 +1,100 @@
+#ifndef MAPPEDFILE_HPP__
+#define MAPPEDFILE_HPP__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <span>
+#include <system_error>
+#include <utility>
+
+namespace SecretShare::FileOperations {
+  namespace fs = std::filesystem;
+
+  // A whole file mapped into memory, read-only or read-write. Unmapped and closed on destruction.
+  class MappedFile {
+   public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept { swap(other); }
+    MappedFile &operator=(MappedFile &&other) noexcept {
+      swap(other);
+      return *this;
+    }
+    ~MappedFile() {
+      if (data_) munmap(data_, size_);
+      if (fd_ >= 0) close(fd_);
+    }
+
+    static MappedFile openRead(const fs::path &path) {
+      MappedFile f;
+      f.fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (f.fd_ < 0) throw systemError("Can't open", path);
+
+      struct stat st;
+      if (fstat(f.fd_, &st) < 0) throw systemError("Can't stat", path);
+      f.map(static_cast<std::size_t>(st.st_size), PROT_READ, path);
+      return f;
+    }
+
+    // Create (or truncate) a file of the given size and map it for writing. The blocks are reserved
+    // up front: a store into a page the full disk has no room for would kill the process with
+    // SIGBUS, where this fails with ENOSPC. Filesystems without fallocate get a sparse file.
+    static MappedFile create(const fs::path &path, std::size_t size) {
+      MappedFile f;
+      f.fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (f.fd_ < 0) throw systemError("Can't create", path);
+      if (size && fallocate(f.fd_, 0, 0, static_cast<off_t>(size)) < 0) {
+        if (errno != EOPNOTSUPP) throw systemError("Can't reserve space for", path);
+        if (ftruncate(f.fd_, static_cast<off_t>(size)) < 0) throw systemError("Can't size", path);
+      }
+      f.map(size, PROT_READ | PROT_WRITE, path);
+      return f;
+    }
+
+    std::span<uint8_t> data() const { return {data_, size_}; }
+    std::size_t size() const { return size_; }
+
+    // hints only: the kernel may ignore them, and so do we if they fail
+    void adviseSequential() const {
+      if (data_) madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+
+    void adviseHugePages() const {
+#if defined(MADV_HUGEPAGE)
+      if (data_) madvise(data_, size_, MADV_HUGEPAGE);
+#endif
+    }
+
+   private:
+    int fd_ = -1;
+    uint8_t *data_ = nullptr;
+    std::size_t size_ = 0;
+
+    void swap(MappedFile &other) noexcept {
+      std::swap(fd_, other.fd_);
+      std::swap(data_, other.data_);
+      std::swap(size_, other.size_);
+    }
+
+    void map(std::size_t size, int prot, const fs::path &path) {
+      size_ = size;
+      if (!size) return;  // nothing to map, and mmap rejects a zero length
+
+      auto p = mmap(nullptr, size, prot, MAP_SHARED, fd_, 0);
+      if (p == MAP_FAILED) throw systemError("Can't map", path);
+      data_ = static_cast<uint8_t *>(p);
+    }
+
+    static std::system_error systemError(const char *what, const fs::path &path) {
+      return std::system_error(errno, std::generic_category(), std::format("{} {}", what, path.string()));
+    }
+  };
+};  // namespace SecretShare::FileOperations
+#endif
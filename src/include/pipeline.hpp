@@ -0,0 +1,172 @@
+#ifndef PIPELINE_HPP__
+#define PIPELINE_HPP__
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace SecretShare::Pipeline {
+  // A bounded multi-producer multi-consumer ring. Each cell carries a sequence number that says
+  // whose turn it is, so producers and consumers claim cells with one compare-and-swap and never
+  // take a lock. push() on a full ring and pop() on an empty one block on that cell's sequence.
+  template <typename T>
+  class RingQueue {
+   public:
+    explicit RingQueue(std::size_t capacity)
+        : mask_(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1), cells_(mask_ + 1) {
+      for (auto i{0uz}; i <= mask_; i++) cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    RingQueue(const RingQueue &) = delete;
+    RingQueue &operator=(const RingQueue &) = delete;
+
+    void push(const T &value) {
+      auto pos = tail_.load(std::memory_order_relaxed);
+      for (;;) {
+        auto &cell = cells_[pos & mask_];
+        auto seq = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+
+        if (diff == 0) {
+          if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            cell.value = value;
+            cell.sequence.store(pos + 1, std::memory_order_release);
+            cell.sequence.notify_all();
+            return;
+          }
+        } else {
+          // full: wait for a consumer to free the cell
+          if (diff < 0) cell.sequence.wait(seq, std::memory_order_acquire);
+          pos = tail_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    T pop() {
+      auto pos = head_.load(std::memory_order_relaxed);
+      for (;;) {
+        auto &cell = cells_[pos & mask_];
+        auto seq = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+
+        if (diff == 0) {
+          if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            T value = cell.value;
+            cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+            cell.sequence.notify_all();
+            return value;
+          }
+        } else {
+          // empty: wait for a producer to fill the cell
+          if (diff < 0) cell.sequence.wait(seq, std::memory_order_acquire);
+          pos = head_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+   private:
+    struct Cell {
+      std::atomic<std::size_t> sequence;
+      T value;
+    };
+
+    // producers and consumers hammer different counters; keep them off each other's cache line
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    std::size_t mask_;
+    std::vector<Cell> cells_;
+  };
+
+  // Streams up to `chunks` numbered chunks through three stages: read() fills a chunk on the calling
+  // thread (or returns false when the input runs out early), one of the workers transforms it, and
+  // then each of `groups` writer threads stores its part of it with write(chunk, index, group), each
+  // from its own queue so that a slow group never holds up a fast one. Once every group is done the
+  // chunk goes back to the reader; the pool bounds the memory in flight. With several workers chunks
+  // can complete out of order, so read and write must then be positioned by the chunk number; with
+  // one worker every group sees the chunks in order. The first exception from any stage stops the
+  // reader, lets the chunks already in flight drain without further work, and is rethrown here.
+  template <typename Chunk, typename Read, typename Workers, typename Write>
+  void run(std::span<Chunk> pool, std::uintmax_t chunks, Read &&read, Workers &workers, Write &&write,
+           unsigned groups) {
+    struct Slot {
+      Chunk *chunk;
+      std::uintmax_t index;
+    };
+
+    auto nworkers = static_cast<unsigned>(std::ranges::distance(workers));
+    groups = std::max(groups, 1u);
+
+    RingQueue<Slot> free(pool.size()), filled(pool.size() + nworkers);
+    std::vector<std::unique_ptr<RingQueue<Slot>>> done;
+    for (auto g{0u}; g < groups; g++) done.push_back(std::make_unique<RingQueue<Slot>>(pool.size() + 1));
+    std::vector<std::atomic<unsigned>> unwritten(pool.size());
+
+    std::atomic<unsigned> computing{nworkers};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto guard = [&](auto &&f) {
+      if (failed.load(std::memory_order_relaxed)) return;
+      try {
+        f();
+      } catch (...) {
+        std::lock_guard lock(errorMutex);
+        if (!error) error = std::current_exception();
+        failed = true;
+      }
+    };
+
+    for (auto &chunk : pool) free.push({&chunk, 0});
+
+    {
+      std::vector<std::jthread> threads;
+
+      for (auto &worker : workers) {
+        threads.emplace_back([&, w = &worker] {
+          for (;;) {
+            auto slot = filled.pop();
+            if (!slot.chunk) break;
+            guard([&] { std::invoke(*w, *slot.chunk, slot.index); });
+            unwritten[slot.chunk - pool.data()] = groups;
+            for (auto &queue : done) queue->push(slot);
+          }
+          if (--computing == 0)
+            for (auto &queue : done) queue->push({nullptr, 0});
+        });
+      }
+
+      for (auto g{0u}; g < groups; g++) {
+        threads.emplace_back([&, g] {
+          for (;;) {
+            auto slot = done[g]->pop();
+            if (!slot.chunk) break;
+            guard([&] { write(*slot.chunk, slot.index, g); });
+            if (--unwritten[slot.chunk - pool.data()] == 0) free.push(slot);
+          }
+        });
+      }
+
+      for (std::uintmax_t n = 0; n < chunks && !failed; n++) {
+        auto slot = free.pop();
+        auto more = false;
+        guard([&] { more = read(*slot.chunk, n); });
+        if (failed || !more) break;
+        filled.push({slot.chunk, n});
+      }
+      for (auto i{0u}; i < nworkers; i++) filled.push({nullptr, 0});
+    }
+
+    if (error) std::rethrow_exception(error);
+  }
+};  // namespace SecretShare::Pipeline
+
+#endif
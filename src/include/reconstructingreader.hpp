@@ -0,0 +1,220 @@
+#ifndef RECONSTRUCTINGREADER_HPP__
+#define RECONSTRUCTINGREADER_HPP__
+#include <fcntl.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "secretshare.hpp"
+#include "sharecontainer.hpp"
+
+namespace SecretShare::FileOperations {
+  // The secret behind k shares, read like a file without ever being written out: pread() and read()
+  // rebuild only the blocks they touch. Rebuilt blocks are kept in a least-recently-used cache, and
+  // a read of the block after the last one is taken for a sequential scan, which fetches a window of
+  // blocks at once and has the kernel start on the shares' next window meanwhile. Containers set the
+  // block size to their chunk size and have every chunk checked before it is used. One call at a
+  // time runs; calls from several threads queue up.
+  class ReconstructingReader {
+   public:
+    static constexpr std::size_t defaultBlockSize = 64 * 1024;
+    static constexpr std::size_t defaultCacheBlocks = 256;
+    static constexpr std::size_t defaultReadahead = 16;
+
+    // The shares at paths, with the share numbers given in points. For containers the numbers come
+    // from the headers, and points may be left empty.
+    ReconstructingReader(std::span<const std::filesystem::path> paths, std::span<const uint8_t> points = {},
+                         std::size_t blockSize = defaultBlockSize,
+                         std::size_t cacheBlocks = defaultCacheBlocks,
+                         std::size_t readahead = defaultReadahead)
+        : blockSize_(blockSize),
+          cacheBlocks_(std::max<std::size_t>(cacheBlocks, 1)),
+          readahead_(readahead) {
+      if (paths.empty()) throw std::invalid_argument("No shares to read");
+      if (!points.empty() && points.size() != paths.size())
+        throw std::invalid_argument("One share number is needed for each share");
+
+      std::optional<ShareHeader> header;
+      for (auto i{0u}; i < paths.size(); i++) {
+        files_.emplace_back(paths[i], O_RDONLY);
+        auto &h = files_.back().header();
+        auto bad = [&](const std::string &what) {
+          return std::system_error(EBADMSG, std::generic_category(),
+                                   std::format("{}: {}", paths[i].string(), what));
+        };
+
+        if (h) {
+          if (!points.empty() && points[i] != h->share) throw bad(std::format("holds share {}", h->share));
+          if (header && (h->setId != header->setId || h->chunkSize != header->chunkSize))
+            throw bad("is from a different split");
+          header = h;
+          points_.push_back(h->share);
+        } else {
+          if (points.empty()) throw bad("is a raw share, so its number must be given");
+          points_.push_back(points[i]);
+        }
+
+        if (i && files_[i].length() != size_) throw bad("differs in length from the other shares");
+        size_ = files_[i].length();
+      }
+      if (header) {
+        if (header->k > files_.size())
+          throw std::invalid_argument(std::format("{} shares are needed", header->k));
+        blockSize_ = header->chunkSize;
+      }
+      if (!blockSize_) throw std::invalid_argument("Block size must not be zero");
+
+      auto top = *std::ranges::max_element(points_);
+      scheme_.emplace(std::max<std::size_t>(top, files_.size()), files_.size());
+      plan_.emplace(scheme_->joinPlan(points_));
+      inputs_.assign(files_.size(), std::vector<uint8_t>(blockSize_));
+    }
+
+    ReconstructingReader(const ReconstructingReader &) = delete;
+    ReconstructingReader &operator=(const ReconstructingReader &) = delete;
+
+    // the length of the secret
+    uint64_t size() const { return size_; }
+
+    // Copy the secret from offset on into buffer. Returns the number of bytes copied, which is short
+    // only at the end of the secret
+    std::size_t pread(uint64_t offset, std::span<uint8_t> buffer) {
+      std::lock_guard lock(mutex_);
+      return copy(offset, buffer);
+    }
+
+    // read from, and move on, the current position, which is shared: concurrent reads each get
+    // bytes of their own
+    std::size_t read(std::span<uint8_t> buffer) {
+      std::lock_guard lock(mutex_);
+      auto n = copy(position_, buffer);
+      position_ += n;
+      return n;
+    }
+
+    void seek(uint64_t position) {
+      std::lock_guard lock(mutex_);
+      position_ = position;
+    }
+    uint64_t tell() const {
+      std::lock_guard lock(mutex_);
+      return position_;
+    }
+
+    // how often a block was found in the cache, and how often it had to be rebuilt
+    uint64_t hits() const {
+      std::lock_guard lock(mutex_);
+      return hits_;
+    }
+    uint64_t misses() const {
+      std::lock_guard lock(mutex_);
+      return misses_;
+    }
+
+   private:
+    struct Block {
+      uint64_t n;
+      std::vector<uint8_t> data;
+    };
+
+    std::vector<ShareFile> files_;
+    std::vector<uint8_t> points_;
+    std::optional<Scheme> scheme_;
+    std::optional<Plan> plan_;
+    uint64_t size_ = 0;
+    std::size_t blockSize_;
+    std::size_t cacheBlocks_;
+    std::size_t readahead_;
+
+    mutable std::mutex mutex_;
+    std::list<Block> lru_;  // most recently used first
+    std::unordered_map<uint64_t, std::list<Block>::iterator> cached_;
+    std::vector<std::vector<uint8_t>> inputs_;
+    uint64_t next_ = 0;  // the block a sequential scan would want next
+    uint64_t position_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+
+    // pread, with the lock held
+    std::size_t copy(uint64_t offset, std::span<uint8_t> buffer) {
+      if (offset >= size_) return 0;
+
+      auto len = static_cast<std::size_t>(std::min<uint64_t>(buffer.size(), size_ - offset));
+      for (std::size_t done = 0; done < len;) {
+        auto position = offset + done;
+        auto &data = block(position / blockSize_);
+        auto within = static_cast<std::size_t>(position % blockSize_);
+        auto n = std::min(data.size() - within, len - done);
+        std::copy_n(data.begin() + within, n, buffer.begin() + done);
+        done += n;
+      }
+      return len;
+    }
+
+    const std::vector<uint8_t> &block(uint64_t n) {
+      auto sequential = n == next_;
+      next_ = n + 1;
+
+      if (auto it = cached_.find(n); it != cached_.end()) {
+        hits_++;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return lru_.front().data;
+      }
+
+      misses_++;
+      auto blocks = (size_ + blockSize_ - 1) / blockSize_;
+      auto window = sequential ? std::max<std::size_t>(readahead_, 1) : 1;
+      window = static_cast<std::size_t>(std::min<uint64_t>({window, cacheBlocks_, blocks - n}));
+
+      // the scan is expected to go on, so the window after this one can be on its way from the disk
+      if (sequential && n + window < blocks)
+        for (auto &file : files_) file.willNeed((n + window) * blockSize_, window * blockSize_);
+
+      // the window is rebuilt back to front, so that the block asked for ends up most recent
+      for (auto b = n + window; b-- > n;)
+        if (!cached_.contains(b)) load(b);
+      return lru_.front().data;
+    }
+
+    void load(uint64_t n) {
+      auto position = n * blockSize_;
+      auto len = static_cast<std::size_t>(std::min<uint64_t>(blockSize_, size_ - position));
+
+      std::vector<std::span<const uint8_t>> inputs;
+      for (auto i{0u}; i < files_.size(); i++) {
+        auto in = std::span(inputs_[i]).first(len);
+        auto crc = files_[i].read(position, in);
+        if (files_[i].container() && crc32c(in) != crc) throw files_[i].corrupt(n);
+        inputs.push_back(in);
+      }
+
+      // take the buffer of the least recently used block if the cache is full
+      Block entry{n, {}};
+      if (lru_.size() >= cacheBlocks_) {
+        entry.data = std::move(lru_.back().data);
+        cached_.erase(lru_.back().n);
+        lru_.pop_back();
+      }
+      entry.data.resize(len);
+
+      const std::array<std::span<uint8_t>, 1> outputs{entry.data};
+      scheme_->evaluate(*plan_, inputs, outputs);
+      lru_.push_front(std::move(entry));
+      cached_[n] = lru_.begin();
+    }
+  };
+};  // namespace SecretShare::FileOperations
+
+#endif
@@ -2,18 +2,35 @@
 #ifndef SECRETSHARE_HPP__
 #define SECRETSHARE_HPP__
 
+#include <sys/random.h>
+#include <sys/uio.h>
+
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <cerrno>
 #include <climits>
 #include <cstdint>
+#include <cstring>
+#include <format>
 #include <memory>
+#include <memory_resource>
 #include <optional>
 #include <print>
 #include <random>
+#include <ranges>
 #include <span>
+#include <stdexcept>
 #include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
 using namespace std::string_view_literals;
 
 namespace SecretShare {
@@ -40,74 +57,775 @@ namespace SecretShare {
 
 #include "nimbermultable.hpp"
 
+  // how split writes all m shares into a single m * len slab: one share after another, or
+  // byte-interleaved so that slab[ix * m + i] holds byte ix of share i + 1
+  enum class Layout { shareMajor, interleaved };
+
+  // The Lagrange coefficients taking the values of a polynomial at inPoints to its values at
+  // outPoints. Building a plan is O(k^2 + mk); reusing one leaves only the per-byte work.
+  class Plan {
+   public:
+    explicit Plan(std::span<const uint8_t> inPoints, std::span<const uint8_t> outPoints,
+                  std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : inPoints_(inPoints.begin(), inPoints.end(), resource),
+          outPoints_(outPoints.begin(), outPoints.end(), resource),
+          coefficients_(inPoints.size() * outPoints.size(), resource),
+          nibbles_(32 * inPoints.size() * outPoints.size(), resource) {
+      std::pmr::vector<uint8_t> inCross(inPoints.size(), resource);
+      std::pmr::vector<uint8_t> outCross(outPoints.size(), resource);
+
+      preflight(inPoints, outPoints, inCross, outCross);
+
+      for (auto i{0u}; i < outPoints.size(); i++) {
+        for (auto j{0u}; j < inPoints.size(); j++) {
+          // an output point that coincides with an input point just copies it
+          auto &c = coefficients_[i * inPoints.size() + j];
+          if (!outCross[i])
+            c = outPoints[i] == inPoints[j];
+          else
+            c = nimberMulTable[outCross[i]]
+                              [nimberDivTable[nimberMulTable[inCross[j]][outPoints[i] ^ inPoints[j]]]];
+
+          // products of c with every low and every high nibble, for the byte-shuffle kernel
+          auto t = &nibbles_[32 * (i * inPoints.size() + j)];
+          for (auto x{0u}; x < 16; x++) {
+            t[x] = nimberMulTable[c][x];
+            t[16 + x] = nimberMulTable[c][x << 4];
+          }
+        }
+      }
+    }
+
+    std::size_t inputs() const { return inPoints_.size(); }
+    std::size_t outputs() const { return outPoints_.size(); }
+    std::span<const uint8_t> inPoints() const { return inPoints_; }
+    std::span<const uint8_t> outPoints() const { return outPoints_; }
+    uint8_t coefficient(std::size_t out, std::size_t in) const {
+      return coefficients_[out * inPoints_.size() + in];
+    }
+    const uint8_t *nibbles(std::size_t out, std::size_t in) const {
+      return &nibbles_[32 * (out * inPoints_.size() + in)];
+    }
+
+   private:
+    std::pmr::vector<uint8_t> inPoints_;
+    std::pmr::vector<uint8_t> outPoints_;
+    std::pmr::vector<uint8_t> coefficients_;
+    std::pmr::vector<uint8_t> nibbles_;
+
+    static void preflight(std::span<const uint8_t> inPoints, std::span<const uint8_t> outPoints,
+                          std::span<uint8_t> inCross, std::span<uint8_t> outCross) {
+      uint8_t n;
+      for (auto i{0u}; i < inPoints.size(); i++) {
+        n = 1;
+        for (auto j{0u}; j < inPoints.size(); j++) {
+          if (j != i) n = nimberMulTable[n][inPoints[i] ^ inPoints[j]];
+        }
+        inCross[i] = n;
+      }
+
+      for (auto i{0u}; i < outPoints.size(); i++) {
+        n = 1;
+        for (auto j{0u}; j < inPoints.size(); j++) {
+          n = nimberMulTable[n][outPoints[i] ^ inPoints[j]];
+        }
+        outCross[i] = n;
+      }
+    }
+  };
+
+  // Shares of a secret of up to MaxLen bytes split m <= MaxShares ways, held inline and returned by
+  // value; share i + 1 is shares[i][0, len)
+  template <std::size_t MaxLen = 64, std::size_t MaxShares = 16>
+  struct SmallShares {
+    std::size_t len;
+    std::size_t count;
+    std::array<std::array<uint8_t, MaxLen>, MaxShares> shares;
+
+    std::span<const uint8_t> operator[](std::size_t i) const { return {shares[i].data(), len}; }
+    std::size_t size() const { return count; }
+  };
+
+  template <std::size_t MaxLen = 64>
+  struct SmallSecret {
+    std::size_t len;
+    std::array<uint8_t, MaxLen> bytes;
+
+    std::span<const uint8_t> view() const { return {bytes.data(), len}; }
+  };
+
+  // The random coefficients for split. Shares 1 to k - 1 are these bytes themselves, so whoever holds
+  // one sees part of the stream, and no part of it may tell anything of the rest: it is ChaCha20
+  // (RFC 8439's block function, with a 64-bit block counter and a 64-bit stream number for its
+  // nonce), made eight blocks at a time with their words interleaved. It is keyed once, on first
+  // use, from getrandom(2), or from an explicit key and stream number, which give the same bytes
+  // every time. A copy rekeys instead of replaying the same stream.
+  class RandomSource {
+   public:
+    using Key = std::array<uint32_t, 8>;
+
+    RandomSource() = default;
+    RandomSource(const Key &key, uint64_t stream) { start(key, stream); }
+    RandomSource(const RandomSource &) {}
+    RandomSource &operator=(const RandomSource &) {
+      keyed_ = false;
+      return *this;
+    }
+
+    // a fresh key from the kernel's random number generator
+    static Key key() {
+      Key key;
+      auto bytes = reinterpret_cast<uint8_t *>(key.data());
+      for (std::size_t done = 0; done < sizeof(key);) {
+        auto n = getrandom(bytes + done, sizeof(key) - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw std::system_error(errno, std::generic_category(), "getrandom");
+        done += static_cast<std::size_t>(n);
+      }
+      return key;
+    }
+
+    void fill(std::span<uint8_t> buffer) {
+      if (!keyed_) start(key(), 0);
+
+      std::size_t ix = 0;
+      while (ix < buffer.size()) {
+        if (used_ == block_.size()) nextBlock();
+        auto n = std::min(block_.size() - used_, buffer.size() - ix);
+        std::memcpy(buffer.data() + ix, block_.data() + used_, n);
+        used_ += n;
+        ix += n;
+      }
+    }
+
+   private:
+    // blocks made at once, side by side, so that the compiler can run them in vector lanes
+    static constexpr std::size_t lanes = 8;
+
+    std::array<uint32_t, 16> state_;
+    std::array<uint8_t, 64 * lanes> block_;
+    std::size_t used_ = 0;
+    bool keyed_ = false;
+
+    void start(const Key &key, uint64_t stream) {
+      // "expand 32-byte k"
+      state_ = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+      std::copy(key.begin(), key.end(), state_.begin() + 4);
+      state_[12] = state_[13] = 0;
+      state_[14] = static_cast<uint32_t>(stream);
+      state_[15] = static_cast<uint32_t>(stream >> 32);
+      used_ = block_.size();
+      keyed_ = true;
+    }
+
+    // a word of each of the blocks; GCC and Clang keep these in vector registers where there are any
+    using Lane = uint32_t __attribute__((vector_size(4 * lanes)));
+
+    static void quarterRound(std::array<Lane, 16> &x, int a, int b, int c, int d) {
+      x[a] += x[b], x[d] ^= x[a], x[d] = (x[d] << 16) | (x[d] >> 16);
+      x[c] += x[d], x[b] ^= x[c], x[b] = (x[b] << 12) | (x[b] >> 20);
+      x[a] += x[b], x[d] ^= x[a], x[d] = (x[d] << 8) | (x[d] >> 24);
+      x[c] += x[d], x[b] ^= x[c], x[b] = (x[b] << 7) | (x[b] >> 25);
+    }
+
+    // the next `lanes` blocks of the keystream
+    void nextBlock() {
+      std::array<Lane, 16> input;
+      for (auto i{0u}; i < 16; i++)
+        for (auto l{0u}; l < lanes; l++) input[i][l] = state_[i];
+      auto counter = (static_cast<uint64_t>(state_[13]) << 32) | state_[12];
+      for (auto l{0u}; l < lanes; l++) {
+        input[12][l] = static_cast<uint32_t>(counter + l);
+        input[13][l] = static_cast<uint32_t>((counter + l) >> 32);
+      }
+      counter += lanes;
+      state_[12] = static_cast<uint32_t>(counter);
+      state_[13] = static_cast<uint32_t>(counter >> 32);
+
+      auto x = input;
+      for (auto round{0u}; round < 10; round++) {
+        quarterRound(x, 0, 4, 8, 12);
+        quarterRound(x, 1, 5, 9, 13);
+        quarterRound(x, 2, 6, 10, 14);
+        quarterRound(x, 3, 7, 11, 15);
+        quarterRound(x, 0, 5, 10, 15);
+        quarterRound(x, 1, 6, 11, 12);
+        quarterRound(x, 2, 7, 8, 13);
+        quarterRound(x, 3, 4, 9, 14);
+      }
+      for (auto i{0u}; i < 16; i++) {
+        x[i] += input[i];
+        if constexpr (std::endian::native == std::endian::little) {
+          std::memcpy(&block_[sizeof(Lane) * i], &x[i], sizeof(Lane));
+          continue;
+        }
+        for (auto l{0u}; l < lanes; l++)
+          for (auto j{0u}; j < 4; j++)
+            block_[sizeof(Lane) * i + 4 * l + j] = static_cast<uint8_t>(x[i][l] >> (8 * j));
+      }
+      used_ = 0;
+    }
+  };
+
   class Scheme {
    public:
-    explicit Scheme(std::size_t m, std::size_t k) : m_(m), k_(k) {};
+    // buffers handed out by the span-based API are aligned for SIMD loads and stores
+    static constexpr std::size_t bufferAlignment = 64;
+
+    explicit Scheme(std::size_t m, std::size_t k,
+                    std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : m_(m), k_(k), resource_(resource) {};
 
     void split(const std::shared_ptr<uint8_t[]> &input, std::size_t len,
                std::vector<std::shared_ptr<uint8_t[]>> &outputs,
                const std::shared_ptr<uint8_t[]> &ranbuf = {}) {
+      outputs.clear();
       outputs.reserve(m_);
-      std::vector<uint8_t> inPoints(k_);
-      std::vector<uint8_t> outPoints(m_);
-      std::vector<uint8_t> inCross(k_);
-      std::vector<uint8_t> outCross(m_);
+      for (auto i{0u}; i < m_; i++) {
+        outputs.push_back(std::allocate_shared_for_overwrite<uint8_t[]>(allocator(), len));
+      }
 
-      for (auto i{0u}; i < k_; i++) inPoints[i] = i;
-      for (auto i{0u}; i < m_; i++) outPoints[i] = i + 1;
+      std::pmr::vector<std::span<uint8_t>> outputSpans(resource_);
+      outputSpans.reserve(m_);
+      for (auto &o : outputs) outputSpans.emplace_back(o.get(), len);
 
-      preflight(inPoints, outPoints, inCross, outCross);
+      split(std::span<const uint8_t>(input.get(), len), outputSpans,
+            ranbuf ? std::span<const uint8_t>(ranbuf.get(), (k_ - 1) * len) : std::span<const uint8_t>{});
+    }
 
-      uint8_t *ranptr = nullptr;
-      std::size_t rbuflen = (k_ - 1) * len;
-      std::shared_ptr<uint8_t[]> tempranbuf;
+    // split into caller-supplied buffers, each at least input.size() bytes long
+    void split(std::span<const uint8_t> input, std::span<const std::span<uint8_t>> outputs,
+               std::span<const uint8_t> ranbuf = {}) {
+      auto len = input.size();
+      checkOutputs(outputs.size(), ranbuf, len);
+      for (auto &out : outputs)
+        if (out.size() < len) throw std::invalid_argument("Share buffer shorter than the input");
 
-      if (ranbuf) {
-        ranptr = ranbuf.get();
-      } else {
-        tempranbuf = std::make_shared_for_overwrite<uint8_t[]>(rbuflen);
+      Scratch tempranbuf(resource_, ranbuf.empty() ? (k_ - 1) * len : 0);
+      const uint8_t *ranptr = ranbuf.empty() ? tempranbuf.buffer.data() : ranbuf.data();
+      if (ranbuf.empty()) random_.fill(tempranbuf.buffer);
+
+      std::pmr::vector<std::span<const uint8_t>> inputs(resource_);
+      inputs.reserve(k_);
+      inputs.push_back(input);
+
+      for (auto i{1u}; i < k_; i++) inputs.emplace_back(ranptr + ((i - 1) * len), len);
 
-        // FILL BUFFER WITH RANDOM DATA
-        std::random_device rd;
-        std::seed_seq randseed{rd(), rd(), rd(), rd(), rd(), rd(), rd(), rd()};
-        std::independent_bits_engine<std::mt19937, CHAR_BIT, uint8_t> randeng(randseed);
+      evaluatePolynomial(splitPlan(), inputs, outputs, len);
+    }
 
-        std::generate_n(tempranbuf.get(), rbuflen, std::ref(randeng));
-        ranptr = tempranbuf.get();
+    // split into m buffers allocated from the scheme's memory resource; see deallocate()
+    std::pmr::vector<std::span<uint8_t>> split(std::span<const uint8_t> input,
+                                               std::span<const uint8_t> ranbuf = {}) {
+      std::pmr::vector<std::span<uint8_t>> outputs(resource_);
+      outputs.reserve(m_);
+      for (auto i{0u}; i < m_; i++) outputs.push_back(allocate(input.size()));
+      split(input, outputs, ranbuf);
+      return outputs;
+    }
+
+    // split into one contiguous slab of m * input.size() bytes
+    void split(std::span<const uint8_t> input, std::span<uint8_t> slab, Layout layout,
+               std::span<const uint8_t> ranbuf = {}) {
+      auto len = input.size();
+      if (slab.size() < m_ * len) throw std::length_error("Share slab too small");
+
+      if (layout == Layout::shareMajor) {
+        std::pmr::vector<std::span<uint8_t>> outputs(resource_);
+        outputs.reserve(m_);
+        for (auto i{0u}; i < m_; i++) outputs.push_back(slab.subspan(i * len, len));
+        split(input, outputs, ranbuf);
+        return;
       }
 
-      std::vector<std::span<uint8_t>> inputs;
-      inputs.reserve(k_);
-      inputs.emplace_back(input.get(), len);
+      Scratch tempranbuf(resource_, ranbuf.empty() ? (k_ - 1) * len : 0);
+      const uint8_t *ranptr = ranbuf.empty() ? tempranbuf.buffer.data() : ranbuf.data();
+      if (ranbuf.empty()) random_.fill(tempranbuf.buffer);
 
+      std::pmr::vector<std::span<const uint8_t>> inputs(resource_);
+      inputs.reserve(k_);
+      inputs.push_back(input);
       for (auto i{1u}; i < k_; i++) inputs.emplace_back(ranptr + ((i - 1) * len), len);
 
-      outputs.clear();
-      for (auto i{0u}; i < m_; i++) {
-        outputs.push_back(std::make_shared_for_overwrite<uint8_t[]>(len));
+      std::pmr::vector<Strided<uint8_t>> outputs(resource_);
+      outputs.reserve(m_);
+      for (auto i{0u}; i < m_; i++) outputs.push_back({slab.data() + i, m_});
+
+      evaluatePolynomial(splitPlan(), inputs, outputs, len);
+    }
+
+    // split a scatter-gather list into m scatter-gather lists, each holding at least as many bytes
+    // as the input; segment boundaries need not line up
+    void split(std::span<const iovec> input, std::span<const std::span<const iovec>> outputs,
+               std::span<const uint8_t> ranbuf = {}) {
+      auto len = segmentsLength(input);
+      checkOutputs(outputs.size(), ranbuf, len);
+      for (auto &o : outputs)
+        if (segmentsLength(o) < len) throw std::length_error("Output segments shorter than input");
+
+      Scratch tempranbuf(resource_, ranbuf.empty() ? (k_ - 1) * len : 0);
+      const uint8_t *ranptr = ranbuf.empty() ? tempranbuf.buffer.data() : ranbuf.data();
+      if (ranbuf.empty()) random_.fill(tempranbuf.buffer);
+
+      SegmentCursor in(input);
+      std::pmr::vector<SegmentCursor> out(outputs.begin(), outputs.end(), resource_);
+      std::pmr::vector<std::span<const uint8_t>> inputSpans(k_, resource_);
+      std::pmr::vector<std::span<uint8_t>> outputSpans(m_, resource_);
+
+      for (std::size_t pos = 0; pos < len;) {
+        auto run = in.available();
+        for (auto &o : out) run = std::min(run, o.available());
+
+        inputSpans[0] = {in.data(), run};
+        for (auto i{1u}; i < k_; i++) inputSpans[i] = {ranptr + ((i - 1) * len) + pos, run};
+        for (auto i{0u}; i < m_; i++) outputSpans[i] = {out[i].data(), run};
+
+        evaluatePolynomial(splitPlan(), inputSpans, outputSpans, run);
+
+        in.advance(run);
+        for (auto &o : out) o.advance(run);
+        pos += run;
       }
+    }
+
+    // split many secrets in one pass. The secrets are laid end to end and shared as a single
+    // buffer, so the plan, the random stream and the vector kernel are set up once for the whole
+    // batch. outputs[i] receives share i + 1 of every secret, in order, and must hold at least the
+    // sum of the secret lengths
+    void splitBatch(std::span<const std::span<const uint8_t>> secrets,
+                    std::span<const std::span<uint8_t>> outputs) {
+      std::size_t total = 0;
+      for (auto &secret : secrets) total += secret.size();
+
+      Scratch gathered(resource_, total);
+      auto pos = gathered.buffer.data();
+      for (auto &secret : secrets) pos = std::copy(secret.begin(), secret.end(), pos);
+
+      split(gathered.buffer, outputs);
+    }
+
+    // split a short secret without touching the heap: the random values and the shares live on the
+    // stack, and the split plan is built once, on first use
+    template <std::size_t MaxLen = 64, std::size_t MaxShares = 16>
+    SmallShares<MaxLen, MaxShares> splitSmall(std::span<const uint8_t> input) {
+      if (input.size() > MaxLen) throw std::length_error("Secret too long for the small-secret path");
+      if (m_ > MaxShares) throw std::length_error("Too many shares for the small-secret path");
+
+      auto &plan = splitPlan();
+
+      std::array<uint8_t, MaxLen *(MaxShares - 1)> ranbuf;
+      random_.fill(std::span(ranbuf.data(), (k_ - 1) * input.size()));
 
-      evaluatePolynomial(inputs, outputs, inCross, outCross, inPoints, outPoints, len);
+      SmallShares<MaxLen, MaxShares> result;
+      result.len = input.size();
+      result.count = m_;
+
+      std::array<std::span<const uint8_t>, MaxShares> inputs;
+      std::array<std::span<uint8_t>, MaxShares> outputs;
+      inputs[0] = input;
+      for (auto i{1u}; i < k_; i++) inputs[i] = {ranbuf.data() + (i - 1) * input.size(), input.size()};
+      for (auto i{0u}; i < m_; i++) outputs[i] = {result.shares[i].data(), input.size()};
+
+      evaluatePolynomial(plan, std::span(inputs.data(), k_), std::span(outputs.data(), m_), input.size());
+      return result;
     }
 
     void join(std::vector<std::shared_ptr<uint8_t[]>> &inputs, std::size_t len,
               const std::vector<uint8_t> &inPoints, std::shared_ptr<uint8_t[]> &&output) {
-      const std::vector<uint8_t> outPoints{0};
-      std::vector<uint8_t> inCross(inputs.size());
-      std::vector<uint8_t> outCross(1);
+      std::pmr::vector<std::span<const uint8_t>> inputSpans(resource_);
+      inputSpans.reserve(inputs.size());
+      for (auto &in : inputs) inputSpans.emplace_back(in.get(), len);
 
-      preflight(inPoints, outPoints, inCross, outCross);
+      output = std::allocate_shared_for_overwrite<uint8_t[]>(allocator(), len);
+      join(inputSpans, inPoints, std::span<uint8_t>(output.get(), len));
+    }
 
-      std::vector<std::shared_ptr<uint8_t[]>> outputv;
-      outputv.push_back(std::make_shared_for_overwrite<uint8_t[]>(len));
+    // join into a caller-supplied buffer; every input must be at least output.size() bytes long
+    void join(std::span<const std::span<const uint8_t>> inputs, std::span<const uint8_t> inPoints,
+              std::span<uint8_t> output) {
+      join(joinPlan(inPoints), inputs, output);
+    }
 
-      evaluatePolynomial(inputs, outputv, inCross, outCross, inPoints, outPoints, len);
-      output = std::move(outputv[0]);
+    // as above, with a plan from joinPlan that is reused across calls
+    void join(const Plan &plan, std::span<const std::span<const uint8_t>> inputs, std::span<uint8_t> output) {
+      checkInputs(plan.inputs(), inputs, output.size());
+      const std::array<std::span<uint8_t>, 1> outputs{output};
+      evaluatePolynomial(plan, inputs, outputs, output.size());
     }
 
+    // join scatter-gather shares into a scatter-gather output; every input must hold at least as
+    // many bytes as the output
+    void join(std::span<const std::span<const iovec>> inputs, std::span<const uint8_t> inPoints,
+              std::span<const iovec> output) {
+      if (inputs.size() != inPoints.size()) throw std::invalid_argument("One point is needed for each share");
+      auto len = segmentsLength(output);
+      for (auto &in : inputs)
+        if (segmentsLength(in) < len) throw std::length_error("Input segments shorter than output");
+
+      auto plan = joinPlan(inPoints);
+
+      std::pmr::vector<SegmentCursor> in(inputs.begin(), inputs.end(), resource_);
+      SegmentCursor out(output);
+      std::pmr::vector<std::span<const uint8_t>> inputSpans(inputs.size(), resource_);
+      std::array<std::span<uint8_t>, 1> outputSpans;
+
+      for (std::size_t pos = 0; pos < len;) {
+        auto run = out.available();
+        for (auto &c : in) run = std::min(run, c.available());
+
+        for (auto j{0u}; j < in.size(); j++) inputSpans[j] = {in[j].data(), run};
+        outputSpans[0] = {out.data(), run};
+
+        evaluatePolynomial(plan, inputSpans, outputSpans, run);
+
+        for (auto &c : in) c.advance(run);
+        out.advance(run);
+        pos += run;
+      }
+    }
+
+    // join the shares at inPoints out of a slab of m shares written by split
+    void join(std::span<const uint8_t> slab, Layout layout, std::span<const uint8_t> inPoints,
+              std::span<uint8_t> output) {
+      auto len = output.size();
+      if (slab.size() < m_ * len) throw std::length_error("Share slab too small");
+      for (auto p : inPoints)
+        if (p < 1 || p > m_) throw std::out_of_range("Share index not in slab");
+
+      std::pmr::vector<Strided<const uint8_t>> inputs(resource_);
+      inputs.reserve(inPoints.size());
+      for (auto p : inPoints) {
+        if (layout == Layout::shareMajor)
+          inputs.push_back({slab.data() + (p - 1) * len, 1});
+        else
+          inputs.push_back({slab.data() + (p - 1), m_});
+      }
+
+      const std::array<std::span<uint8_t>, 1> outputs{output};
+      evaluatePolynomial(joinPlan(inPoints), inputs, outputs, len);
+    }
+
+    // join into a buffer allocated from the scheme's memory resource; see deallocate()
+    std::span<uint8_t> join(std::span<const std::span<const uint8_t>> inputs,
+                            std::span<const uint8_t> inPoints, std::size_t len) {
+      auto output = allocate(len);
+      join(inputs, inPoints, output);
+      return output;
+    }
+
+    // join short shares without touching the heap
+    template <std::size_t MaxLen = 64, std::size_t MaxShares = 16>
+    SmallSecret<MaxLen> joinSmall(std::span<const std::span<const uint8_t>> inputs,
+                                  std::span<const uint8_t> inPoints) {
+      if (inputs.empty() || inputs.size() > MaxShares) throw std::length_error("Wrong number of shares");
+      auto len = inputs[0].size();
+      if (len > MaxLen) throw std::length_error("Share too long for the small-secret path");
+      checkInputs(inPoints.size(), inputs, len);
+      for (auto &in : inputs)
+        if (in.size() != len) throw std::invalid_argument("Shares differ in length");
+
+      std::array<std::byte, smallPlanBytes(MaxShares, 1)> planBuffer;
+      std::pmr::monotonic_buffer_resource planResource(planBuffer.data(), planBuffer.size(),
+                                                       std::pmr::null_memory_resource());
+      const uint8_t zero = 0;
+      Plan plan(inPoints, std::span<const uint8_t>(&zero, 1), &planResource);
+
+      SmallSecret<MaxLen> result;
+      result.len = len;
+
+      const std::array<std::span<uint8_t>, 1> outputs{std::span<uint8_t>(result.bytes.data(), len)};
+      evaluatePolynomial(plan, inputs, outputs, len);
+      return result;
+    }
+
+    // join shares written by splitBatch back into the individual secrets, whose lengths give the
+    // layout of the batch
+    void joinBatch(std::span<const std::span<const uint8_t>> inputs, std::span<const uint8_t> inPoints,
+                   std::span<const std::span<uint8_t>> secrets) {
+      std::size_t total = 0;
+      for (auto &secret : secrets) total += secret.size();
+
+      Scratch joined(resource_, total);
+      join(inputs, inPoints, joined.buffer);
+
+      auto pos = joined.buffer.data();
+      for (auto &secret : secrets) {
+        std::copy_n(pos, secret.size(), secret.begin());
+        pos += secret.size();
+      }
+    }
+
+    // Shares are linear in the secret: with the same random values, changing the secret by delta
+    // (XOR) changes share i by L0(i) * delta, L0(i) being the split plan's coefficient taking the
+    // secret to share i. So shares can be patched in place for an edit of the secret: delta is the
+    // old bytes XOR the new ones at `offset`, and shares[i], share i + 1, is patched at the same
+    // offset. Shares 1 to k - 1 hold the random values themselves and do not change; anyone who
+    // sees another share before and after learns the delta, as nothing fresh is mixed in.
+    void applyDelta(std::size_t offset, std::span<const uint8_t> delta,
+                    std::span<const std::span<uint8_t>> shares) {
+      if (shares.size() != m_) throw std::invalid_argument("One buffer is needed for each share");
+      auto &plan = splitPlan();
+      for (auto i{0u}; i < m_; i++) {
+        if (shares[i].size() < offset + delta.size())
+          throw std::invalid_argument("Share too short for the delta");
+        multiplyAccumulate(plan.coefficient(i, 0), plan.nibbles(i, 0), delta.data(),
+                           shares[i].data() + offset, delta.size(), true);
+      }
+    }
+
+    // Re-randomise a share without touching the secret: add to it its part of a random sharing of
+    // zero, the polynomial through 0 at point 0 and the k - 1 values in ranbuf (each share.size()
+    // bytes, one after another) at points 1 to k - 1. Shares all refreshed with the same ranbuf
+    // still join to the same secret, but no longer with shares from before. Taking one share at a
+    // time lets a caller go through them one after another, regenerating ranbuf for each.
+    void refresh(std::span<const uint8_t> ranbuf, uint8_t point, std::span<uint8_t> share) {
+      auto len = share.size();
+      if (ranbuf.size() < (k_ - 1) * len) throw std::invalid_argument("Not enough random bytes");
+
+      std::pmr::vector<uint8_t> inPoints(k_, resource_);
+      for (auto i{0u}; i < k_; i++) inPoints[i] = i;
+      Plan plan(inPoints, std::span<const uint8_t>(&point, 1), resource_);
+
+      for (auto j{1u}; j < k_; j++)
+        multiplyAccumulate(plan.coefficient(0, j), plan.nibbles(0, j), ranbuf.data() + (j - 1) * len,
+                           share.data(), len, true);
+    }
+
+    // run a plan over contiguous buffers of equal length. Touches no scheme state, so any number
+    // of threads may call it at once
+    void evaluate(const Plan &plan, std::span<const std::span<const uint8_t>> inputs,
+                  std::span<const std::span<uint8_t>> outputs) const {
+      if (outputs.size() != plan.outputs()) throw std::invalid_argument("Buffers do not match plan");
+      auto len = outputs.empty() ? 0 : outputs[0].size();
+      for (auto &out : outputs)
+        if (out.size() != len) throw std::invalid_argument("Outputs differ in length");
+      checkInputs(plan.inputs(), inputs, len);
+      evaluatePolynomial(plan, inputs, outputs, len);
+    }
+
+    // the plan split uses: the secret at point 0 and k - 1 random values at points 1 to k - 1,
+    // evaluated at points 1 to m. It is kept for the life of the scheme, so it comes from the heap:
+    // an Arena given to the scheme is reset between calls, and would hand its memory out again
+    const Plan &splitPlan() {
+      if (!splitPlan_) {
+        std::pmr::vector<uint8_t> inPoints(k_, resource_);
+        std::pmr::vector<uint8_t> outPoints(m_, resource_);
+
+        for (auto i{0u}; i < k_; i++) inPoints[i] = i;
+        for (auto i{0u}; i < m_; i++) outPoints[i] = i + 1;
+
+        splitPlan_.emplace(inPoints, outPoints, std::pmr::new_delete_resource());
+      }
+      return *splitPlan_;
+    }
+
+    // the plan join uses to recover the value at point 0 from the shares at inPoints
+    Plan joinPlan(std::span<const uint8_t> inPoints) const {
+      const uint8_t zero = 0;
+      return Plan(inPoints, std::span<const uint8_t>(&zero, 1), resource_);
+    }
+
+    // the plan taking the shares at inPoints to new shares at outPoints. The secret's point is not
+    // one of them, so the polynomial is evaluated without the secret ever being formed
+    Plan derivePlan(std::span<const uint8_t> inPoints, std::span<const uint8_t> outPoints) const {
+      if (std::ranges::find(outPoints, 0) != outPoints.end())
+        throw std::invalid_argument("Point 0 is the secret, not a share");
+      return Plan(inPoints, outPoints, resource_);
+    }
+
+    // the shares at outPoints, computed from the shares at inPoints: to recreate a lost share, or to
+    // issue more shares of the same split. Every output is as long as the first
+    void derive(std::span<const std::span<const uint8_t>> inputs, std::span<const uint8_t> inPoints,
+                std::span<const uint8_t> outPoints, std::span<const std::span<uint8_t>> outputs) const {
+      evaluate(derivePlan(inPoints, outPoints), inputs, outputs);
+    }
+
+    // the plan decode uses: the secret, and the values at the rest of inPoints, from the first k
+    Plan decodePlan(std::span<const uint8_t> inPoints) const {
+      if (inPoints.size() <= k_) throw std::invalid_argument("Decoding needs more than k shares");
+      std::pmr::vector<uint8_t> outPoints(1, 0, resource_);
+      outPoints.insert(outPoints.end(), inPoints.begin() + k_, inPoints.end());
+      return Plan(inPoints.first(k_), outPoints, resource_);
+    }
+
+    // Join n > k shares, correcting up to (n - k) / 2 wrong ones in every byte. The first k shares are
+    // joined and the others predicted from them; where every prediction holds the join stands, and a
+    // pass over the differences, left in checks (n - k buffers as long as the output), finds that out
+    // at little more than the cost of a plain join. Only bytes where one differs are decoded again
+    // from all n shares. Returns the number of bytes corrected; errors, if given, counts for each
+    // input the bytes in which it was wrong. A byte with too many wrong shares to correct (with one
+    // spare share, any wrong one) is left as the first k join it, and added to uncorrectable, if
+    // given, as part of a run [first, last) of such bytes; without it decode throws
+    // std::domain_error there. Its scratch comes from the scheme's memory resource, so threads may
+    // call it at once only if that resource may be shared, as the default one can and an Arena can't
+    std::size_t decode(const Plan &plan, std::span<const std::span<const uint8_t>> inputs,
+                       std::span<uint8_t> output, std::span<const std::span<uint8_t>> checks,
+                       std::span<std::uintmax_t> errors = {},
+                       std::vector<std::pair<std::size_t, std::size_t>> *uncorrectable = nullptr) const {
+      auto k = plan.inputs();
+      auto n = k + plan.outputs() - 1;
+      auto len = output.size();
+      if (checks.size() != n - k || (!errors.empty() && errors.size() != n))
+        throw std::invalid_argument("Buffers do not match plan");
+      checkInputs(n, inputs, len);
+      for (auto &check : checks)
+        if (check.size() < len) throw std::invalid_argument("Check buffer shorter than the output");
+
+      std::pmr::vector<std::span<uint8_t>> outputs(resource_);
+      outputs.push_back(output);
+      for (auto &check : checks) outputs.push_back(check.first(len));
+      evaluatePolynomial(plan, inputs.first(k), outputs, len);
+
+      std::pmr::vector<uint8_t> points(plan.inPoints().begin(), plan.inPoints().end(), resource_);
+      points.insert(points.end(), plan.outPoints().begin() + 1, plan.outPoints().end());
+      std::pmr::vector<uint8_t> values(n, resource_);
+      std::pmr::vector<uint8_t> wrong(n, resource_);
+      std::pmr::vector<uint8_t> system(resource_);
+      std::size_t corrected = 0;
+
+      for (std::size_t base = 0; base < len; base += blockSize) {
+        auto run = std::min(blockSize, len - base);
+        uint8_t differs = 0;
+        for (auto j{0u}; j < n - k; j++) {
+          auto check = outputs[j + 1].data() + base;
+          auto actual = inputs[k + j].data() + base;
+          for (std::size_t ix = 0; ix < run; ix++) {
+            check[ix] ^= actual[ix];
+            differs |= check[ix];
+          }
+        }
+        if (!differs) continue;
+
+        for (auto ix = base; ix < base + run; ix++) {
+          if (std::ranges::none_of(outputs | std::views::drop(1), [&](auto &check) { return check[ix]; }))
+            continue;
+          for (auto i{0u}; i < n; i++) values[i] = inputs[i][ix];
+          auto secret = correct(points, values, k, wrong, system);
+          if (!secret) {
+            if (!uncorrectable)
+              throw std::domain_error(std::format("Too many wrong shares to correct at byte {}", ix));
+            if (!uncorrectable->empty() && uncorrectable->back().second == ix)
+              uncorrectable->back().second++;
+            else
+              uncorrectable->emplace_back(ix, ix + 1);
+            continue;
+          }
+          output[ix] = *secret;
+          corrected++;
+          if (!errors.empty())
+            for (auto i{0u}; i < n; i++) errors[i] += wrong[i];
+        }
+      }
+      return corrected;
+    }
+
+    // buffers from the scheme's resource belong to it; an Arena reclaims them wholesale on reset(),
+    // any other resource expects them to be handed back here
+    std::span<uint8_t> allocate(std::size_t len) {
+      return {static_cast<uint8_t *>(resource_->allocate(len, bufferAlignment)), len};
+    }
+
+    void deallocate(std::span<uint8_t> buffer) {
+      resource_->deallocate(buffer.data(), buffer.size(), bufferAlignment);
+    }
+
+    std::pmr::memory_resource *resource() const { return resource_; }
+    std::size_t m() const { return m_; }
+    std::size_t k() const { return k_; }
+
    private:
+    // bytes per input processed for every output before moving on, so the working set of a block
+    // stays in L1
+    static constexpr std::size_t blockSize = 4096;
+
     std::size_t m_;
     std::size_t k_;
+    std::pmr::memory_resource *resource_;
+    std::optional<Plan> splitPlan_;
+    RandomSource random_;
+
+    // a plan reads one input for each of its points, len bytes from each; anything less would take
+    // it out of bounds
+    static void checkInputs(std::size_t points, std::span<const std::span<const uint8_t>> inputs,
+                            std::size_t len) {
+      if (inputs.size() != points) throw std::invalid_argument("One point is needed for each share");
+      for (auto &in : inputs)
+        if (in.size() < len) throw std::invalid_argument("Share shorter than the output");
+    }
+
+    // a split writes m shares, and reads k - 1 random values for each byte if it is given them
+    void checkOutputs(std::size_t outputs, std::span<const uint8_t> ranbuf, std::size_t len) const {
+      if (outputs != m_) throw std::invalid_argument("One buffer is needed for each share");
+      if (!ranbuf.empty() && ranbuf.size() < (k_ - 1) * len)
+        throw std::invalid_argument("Not enough random bytes");
+    }
+
+    // room for a plan's points, coefficients, nibble tables and preflight scratch, with slack for
+    // alignment
+    static constexpr std::size_t smallPlanBytes(std::size_t inputs, std::size_t outputs) {
+      return 2 * (inputs + outputs) + 33 * inputs * outputs + 8 * alignof(std::max_align_t);
+    }
+
+    template <typename T>
+    struct Strided {
+      T *data;
+      std::size_t stride;
+      T &operator[](std::size_t ix) const { return data[ix * stride]; }
+    };
+
+    // walks a scatter-gather list, skipping empty segments
+    struct SegmentCursor {
+      SegmentCursor(std::span<const iovec> segments) : segments_(segments), index_(0), offset_(0) {
+        skipEmpty();
+      }
+
+      std::size_t available() const {
+        return index_ < segments_.size() ? segments_[index_].iov_len - offset_ : 0;
+      }
+      uint8_t *data() const { return static_cast<uint8_t *>(segments_[index_].iov_base) + offset_; }
+
+      void advance(std::size_t n) {
+        offset_ += n;
+        if (offset_ == segments_[index_].iov_len) {
+          index_++;
+          offset_ = 0;
+          skipEmpty();
+        }
+      }
+
+     private:
+      std::span<const iovec> segments_;
+      std::size_t index_;
+      std::size_t offset_;
+
+      void skipEmpty() {
+        while (index_ < segments_.size() && !segments_[index_].iov_len) index_++;
+      }
+    };
+
+    static std::size_t segmentsLength(std::span<const iovec> segments) {
+      std::size_t len = 0;
+      for (auto &s : segments) len += s.iov_len;
+      return len;
+    }
+
+    struct Scratch {
+      Scratch(std::pmr::memory_resource *resource, std::size_t len)
+          : resource_(resource),
+            buffer(len ? static_cast<uint8_t *>(resource->allocate(len, bufferAlignment)) : nullptr, len) {}
+      Scratch(const Scratch &) = delete;
+      Scratch &operator=(const Scratch &) = delete;
+      ~Scratch() {
+        if (buffer.data()) resource_->deallocate(buffer.data(), buffer.size(), bufferAlignment);
+      }
+
+      std::pmr::memory_resource *resource_;
+      std::span<uint8_t> buffer;
+    };
+
+    std::pmr::polymorphic_allocator<uint8_t> allocator() const {
+      return std::pmr::polymorphic_allocator<uint8_t>(resource_);
+    }
 
     constexpr uint8_t multiplyNimbers(uint8_t a, uint8_t b) {
       uint8_t n;
@@ -120,56 +838,160 @@ namespace SecretShare {
       return n;
     }
 
-    void preflight(const std::vector<uint8_t> &inPoints, const std::vector<uint8_t> &outPoints,
-                   std::vector<uint8_t> &inCross, std::vector<uint8_t> &outCross) {
-      uint8_t n;
-      for (auto i{0u}; i < inPoints.size(); i++) {
-        n = 1;
-        for (auto j{0u}; j < inPoints.size(); j++) {
-          if (j != i) n = nimberMulTable[n][inPoints[i] ^ inPoints[j]];
+    // dst = c * src, or dst ^= c * src when accumulating. Multiplying by a constant is linear over
+    // GF(2), so c * x = c * (x & 0x0f) ^ c * (x & 0xf0), and the plan's two 16-entry tables of those
+    // products fit a byte shuffle
+    static void multiplyAccumulate(uint8_t c, [[maybe_unused]] const uint8_t *nibbles, const uint8_t *src,
+                                   uint8_t *dst, std::size_t len, bool accumulate) {
+      std::size_t ix = 0;
+
+      if (!c) {
+        if (!accumulate) std::fill_n(dst, len, 0);
+        return;
+      }
+
+      if (c == 1) {
+        if (!accumulate)
+          std::copy_n(src, len, dst);
+        else
+          for (; ix < len; ix++) dst[ix] ^= src[ix];
+        return;
+      }
+
+#if defined(__SSSE3__)
+      const __m128i tlo16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(nibbles));
+      const __m128i thi16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(nibbles + 16));
+      const __m128i mask16 = _mm_set1_epi8(0x0f);
+#if defined(__AVX2__)
+      const __m256i tlo = _mm256_broadcastsi128_si256(tlo16);
+      const __m256i thi = _mm256_broadcastsi128_si256(thi16);
+      const __m256i mask = _mm256_set1_epi8(0x0f);
+      for (; ix + 32 <= len; ix += 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + ix));
+        auto r = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, _mm256_and_si256(v, mask)),
+                                  _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(v, 4), mask)));
+        if (accumulate)
+          r = _mm256_xor_si256(r, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + ix)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + ix), r);
+      }
+#endif
+      for (; ix + 16 <= len; ix += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + ix));
+        auto r = _mm_xor_si128(_mm_shuffle_epi8(tlo16, _mm_and_si128(v, mask16)),
+                               _mm_shuffle_epi8(thi16, _mm_and_si128(_mm_srli_epi64(v, 4), mask16)));
+        if (accumulate) r = _mm_xor_si128(r, _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + ix)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ix), r);
+      }
+#endif
+
+      const uint8_t *row = nimberMulTable[c];
+      if (accumulate)
+        for (; ix < len; ix++) dst[ix] ^= row[src[ix]];
+      else
+        for (; ix < len; ix++) dst[ix] = row[src[ix]];
+    }
+
+    // Berlekamp–Welch for one byte: the value at 0 of the polynomial P of degree below k through the
+    // values at points, all but at most e = (n - k) / 2 of them. An error locator E, monic of degree
+    // e, and Q = P E, of degree below e + k, have Q(x) = y E(x) at every point: a linear system in
+    // their coefficients. P is then Q / E, and wrong marks the values it misses. Returns nullopt when
+    // no such P exists, as more than e values are wrong
+    static std::optional<uint8_t> correct(std::span<const uint8_t> points, std::span<const uint8_t> values,
+                                          std::size_t k, std::span<uint8_t> wrong,
+                                          std::pmr::vector<uint8_t> &system) {
+      auto n = points.size();
+      auto e = (n - k) / 2;
+      auto unknowns = e + k + e;  // Q's coefficients, then E's below x^e
+      auto width = unknowns + 1;  // and the right-hand side, y x^e
+      system.assign(n * width, 0);
+
+      for (auto i{0u}; i < n; i++) {
+        auto row = &system[i * width];
+        uint8_t power = 1;
+        for (auto j{0u}; j < e + k; j++) {
+          row[j] = power;
+          if (j < e) row[e + k + j] = nimberMulTable[values[i]][power];
+          if (j == e) row[unknowns] = nimberMulTable[values[i]][power];
+          power = nimberMulTable[power][points[i]];
         }
-        inCross[i] = n;
       }
 
-      for (auto i{0u}; i < outPoints.size(); i++) {
-        n = 1;
-        for (auto j{0u}; j < inPoints.size(); j++) {
-          n = nimberMulTable[n][outPoints[i] ^ inPoints[j]];
+      // Gauss-Jordan elimination; unknowns without a pivot are free, and left at 0
+      std::array<std::size_t, 256> pivot;
+      pivot.fill(n);
+      std::size_t rank = 0;
+      for (auto c{0u}; c < unknowns && rank < n; c++) {
+        auto r = rank;
+        while (r < n && !system[r * width + c]) r++;
+        if (r == n) continue;
+        std::swap_ranges(&system[r * width], &system[r * width] + width, &system[rank * width]);
+
+        auto top = &system[rank * width];
+        auto inverse = nimberDivTable[top[c]];
+        for (auto j = c; j < width; j++) top[j] = nimberMulTable[top[j]][inverse];
+        for (auto i{0u}; i < n; i++) {
+          auto f = system[i * width + c];
+          if (i == rank || !f) continue;
+          for (auto j = c; j < width; j++) system[i * width + j] ^= nimberMulTable[f][top[j]];
         }
-        outCross[i] = n;
+        pivot[c] = rank++;
       }
-    }
+      for (auto i = rank; i < n; i++)
+        if (system[i * width + unknowns]) return std::nullopt;
 
-    inline void evaluatePolynomial(const std::vector<std::shared_ptr<uint8_t[]>> &inputs,
-                                   const std::vector<std::shared_ptr<uint8_t[]>> &outputs,
-                                   const std::vector<uint8_t> &inCross, const std::vector<uint8_t> &outCross,
-                                   const std::vector<uint8_t> &inPoints,
-                                   const std::vector<uint8_t> &outPoints, std::size_t len) {
-      std::vector<std::span<uint8_t>> inputSpans;
-      for (auto &in : inputs) inputSpans.emplace_back(in.get(), len);
-      evaluatePolynomial(inputSpans, outputs, inCross, outCross, inPoints, outPoints, len);
+      std::array<uint8_t, 256> q{};
+      std::array<uint8_t, 256> locator{};
+      for (auto j{0u}; j < unknowns; j++) {
+        auto v = pivot[j] < n ? system[pivot[j] * width + unknowns] : uint8_t{0};
+        if (j < e + k)
+          q[j] = v;
+        else
+          locator[j - e - k] = v;
+      }
+      locator[e] = 1;
+
+      // P = Q / E by long division, E being monic; anything left over means too many errors
+      std::array<uint8_t, 256> p{};
+      for (auto d = e + k; d-- > e;) {
+        auto c = q[d];
+        p[d - e] = c;
+        for (auto t{0u}; t <= e; t++) q[d - e + t] ^= nimberMulTable[c][locator[t]];
+      }
+      if (std::any_of(q.begin(), q.begin() + e, [](uint8_t r) { return r != 0; })) return std::nullopt;
+
+      for (auto i{0u}; i < n; i++) {
+        uint8_t v = 0;
+        for (auto d = k; d-- > 0;) v = nimberMulTable[v][points[i]] ^ p[d];
+        wrong[i] = v != values[i];
+      }
+      return p[0];
     }
 
-    inline void evaluatePolynomial(const std::vector<std::span<uint8_t>> &inputs,
-                                   const std::vector<std::shared_ptr<uint8_t[]>> &outputs,
-                                   const std::vector<uint8_t> &inCross, const std::vector<uint8_t> &outCross,
-                                   const std::vector<uint8_t> &inPoints,
-                                   const std::vector<uint8_t> &outPoints, std::size_t len) {
-      uint8_t n;
-      for (auto ix{0u}; ix < len; ix++) {
-        for (auto i{0u}; i < outputs.size(); i++) {
-          n = 0;
-          if (!outCross[i]) {
+    template <typename Inputs, typename Outputs>
+    static inline void evaluatePolynomial(const Plan &plan, const Inputs &inputs, const Outputs &outputs,
+                                          std::size_t len) {
+      using In = std::remove_cvref_t<decltype(inputs[0])>;
+      using Out = std::remove_cvref_t<decltype(outputs[0])>;
+
+      if constexpr (std::is_convertible_v<In, std::span<const uint8_t>> &&
+                    std::is_convertible_v<Out, std::span<uint8_t>>) {
+        // contiguous buffers: one output at a time, block by block, through the vector kernel
+        for (std::size_t base = 0; base < len; base += blockSize) {
+          auto n = std::min(blockSize, len - base);
+          for (auto i{0u}; i < outputs.size(); i++)
             for (auto j{0u}; j < inputs.size(); j++)
-              if (outPoints[i] == inPoints[j]) n = inputs[j][ix];
-          } else {
+              multiplyAccumulate(plan.coefficient(i, j), plan.nibbles(i, j), inputs[j].data() + base,
+                                 outputs[i].data() + base, n, j != 0);
+        }
+      } else {
+        uint8_t n;
+        for (std::size_t ix = 0; ix < len; ix++) {
+          for (auto i{0u}; i < outputs.size(); i++) {
+            n = 0;
             for (auto j{0u}; j < inputs.size(); j++)
-              n ^= nimberMulTable
-                  [inputs[j][ix]]
-                  [nimberMulTable[outCross[i]]
-                                 [nimberDivTable[nimberMulTable[inCross[j]][outPoints[i] ^ inPoints[j]]]]];
+              n ^= nimberMulTable[plan.coefficient(i, j)][inputs[j][ix]];
+            outputs[i][ix] = n;
           }
-          outputs[i][ix] = n;
         }
       }
     }
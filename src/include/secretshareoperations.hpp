@@ -1,97 +1,1485 @@
 #ifndef SECRETSHAREOPERATIONS_HPP__
 #define SECRETSHAREOPERATIONS_HPP__
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <bitset>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <format>
+#include <fstream>
+#include <limits>
 #include <memory>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <print>
 #include <set>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "arena.hpp"
 #include "commandline.hpp"
+#include "ioengine.hpp"
+#include "mappedfile.hpp"
+#include "pipeline.hpp"
+#include "secretshare.hpp"
+#include "sharecontainer.hpp"
 using namespace SecretShare;
 
 namespace SecretShare::SecretSHareOperations {
   namespace fs = std::filesystem;
 
-  static void splitFile(const fs::path &filepath, std::uintmax_t fsize, std::size_t m, std::size_t k) {
-    std::shared_ptr<uint8_t[]> input;
+  // files are processed this many bytes at a time, so memory use does not grow with file size
+  inline constexpr std::size_t chunkSize = 4 * 1024 * 1024;
+
+  // the threaded pipeline keeps at most this much chunk memory in flight
+  inline constexpr std::size_t pipelineMemory = 256 * 1024 * 1024;
+
+  // how a pipeline runs: the chunks in its pool, the size of each of their buffers, and the workers
+  struct PipelineShape {
+    std::size_t pool;
+    std::size_t bufsize;
+    unsigned threads;
+  };
+
+  // Enough chunks to keep every stage busy, each as large as the memory budget allows for a chunk
+  // made of the given number of buffers, but no smaller than 64 KiB; a container's chunk size is
+  // `fixed`. Chunks at that floor can overrun the budget, so then the pool is cut to what fits, and
+  // the workers with it. A budget that can't hold even one chunk is an error.
+  static PipelineShape pipelineShape(std::uintmax_t fsize, std::size_t buffers, unsigned threads,
+                                     unsigned writers, std::size_t fixed = 0) {
+    threads = std::max(threads, 1u);
+    std::size_t pool = threads + writers + 2;
+    // a multiple of the direct I/O block, so only the last chunk of a file can be unaligned
+    auto block = FileOperations::DirectFile::alignment;
+    auto size = fixed;
+    if (!size) {
+      auto share = pipelineMemory / (pool * buffers);
+      size = std::clamp<std::size_t>((share - std::min(share, block)) / block * block, 64 * 1024, chunkSize);
+      size = static_cast<std::size_t>(std::min<std::uintmax_t>(fsize, size));
+    }
+
+    auto fits = pipelineMemory / (buffers * (size + block));
+    if (!fits) {
+      std::println("Can't run the pipeline: a chunk of {} buffers of {} bytes is over the {} byte budget",
+                   buffers, size, pipelineMemory);
+      throw std::length_error("chunk over the memory budget");
+    }
+    if (pool > fits) {
+      pool = fits;
+      // the reader and the writers hold chunks too; what is left is for the workers
+      auto others = std::min<std::size_t>(pool, writers + 2);
+      threads = static_cast<unsigned>(std::clamp<std::size_t>(pool - others, 1, threads));
+    }
+    return {pool, size, threads};
+  }
+
+  // one chunk of the pipeline: the buffers it is read into and computed into
+  struct PipelineChunk {
+    std::vector<std::span<uint8_t>> inputs;
+    std::vector<std::span<uint8_t>> outputs;
+    std::vector<uint32_t> crcs;  // of the outputs, or as read with the inputs, for containers
+    std::vector<bool> unread;    // inputs that could not be read, for a join that works round them
+    std::size_t len;
+    FileOperations::Pages pages;  // output memory to be given to a pipe, when joining into one
+  };
+
+  // block-aligned, so that whole chunks can go straight to and from the disk with O_DIRECT
+  static std::vector<PipelineChunk> chunkPool(Arena &buffers, std::size_t count, std::size_t inputs,
+                                              std::size_t outputs, std::size_t bufsize) {
+    auto buffer = [&] {
+      auto p = buffers.allocate(bufsize, FileOperations::DirectFile::alignment);
+      return std::span<uint8_t>(static_cast<uint8_t *>(p), bufsize);
+    };
+
+    std::vector<PipelineChunk> pool(count);
+    for (auto &chunk : pool) {
+      for (auto i{0u}; i < inputs; i++) chunk.inputs.push_back(buffer());
+      for (auto i{0u}; i < outputs; i++) chunk.outputs.push_back(buffer());
+      chunk.crcs.resize(std::max(inputs, outputs));
+      chunk.unread.resize(inputs);
+    }
+    return pool;
+  }
+
+  // every split worker has its own scheme, random stream and scratch arena. For containers it also
+  // checksums the shares, so that work is spread over the workers too
+  class SplitWorker {
+   public:
+    SplitWorker(std::size_t m, std::size_t k, std::size_t bufsize, bool checksums = false)
+        : arena_((k - 1) * bufsize + Arena::alignment * (k + m + 8)),
+          scheme_(m, k, &arena_),
+          checksums_(checksums) {}
+
+    void operator()(PipelineChunk &chunk, std::uintmax_t) {
+      outputs_.clear();
+      for (auto &o : chunk.outputs) outputs_.push_back(o.first(chunk.len));
+      scheme_.split(chunk.inputs[0].first(chunk.len), outputs_);
+      arena_.reset();
+
+      if (checksums_)
+        for (auto i{0u}; i < outputs_.size(); i++) chunk.crcs[i] = FileOperations::crc32c(outputs_[i]);
+    }
+
+   private:
+    Arena arena_;
+    SecretShare::Scheme scheme_;
+    std::vector<std::span<uint8_t>> outputs_;
+    bool checksums_;
+  };
+
+  // a join plan only reads the scheme, so the join workers share one. Chunks of container shares
+  // are checked against their checksums here, on the workers, before they are used; the pipeline's
+  // chunk n is the files' chunk first + n. The plan has an output for each of the chunk's outputs:
+  // the secret when joining, new shares when deriving them, which with `checksums` have their
+  // CRCs put in the chunk for containers
+  class JoinWorker {
+   public:
+    JoinWorker(const SecretShare::Scheme &scheme, const Plan &plan,
+               std::span<const FileOperations::ShareFile> files = {}, std::uintmax_t first = 0,
+               bool checksums = false)
+        : scheme_(scheme), plan_(plan), files_(files), first_(first), checksums_(checksums) {}
+
+    void operator()(PipelineChunk &chunk, std::uintmax_t n) {
+      inputs_.clear();
+      for (auto &in : chunk.inputs) inputs_.push_back(in.first(chunk.len));
+
+      for (auto i{0u}; i < files_.size(); i++)
+        if (files_[i].container() && FileOperations::crc32c(inputs_[i]) != chunk.crcs[i])
+          throw files_[i].corrupt(first_ + n);
+
+      outputs_.clear();
+      for (auto i{0u}; i < plan_.outputs(); i++) outputs_.push_back(chunk.outputs[i].first(chunk.len));
+      scheme_.evaluate(plan_, inputs_, outputs_);
+
+      if (checksums_)
+        for (auto i{0u}; i < outputs_.size(); i++) chunk.crcs[i] = FileOperations::crc32c(outputs_[i]);
+    }
+
+   private:
+    const SecretShare::Scheme &scheme_;
+    const Plan &plan_;
+    std::span<const FileOperations::ShareFile> files_;
+    std::uintmax_t first_;
+    bool checksums_;
+    std::vector<std::span<const uint8_t>> inputs_;
+    std::vector<std::span<uint8_t>> outputs_;
+  };
+
+  // The plans of a join that works round damaged shares: one for each set of shares some chunk is
+  // joined from, built the first time a chunk needs it. Sets of k shares are joined
+  // (Scheme::joinPlan), larger ones decoded (Scheme::decodePlan). Shared by the workers
+  class PlanCache {
+   public:
+    // the inputs in a set, by position
+    using Subset = std::bitset<256>;
+
+    PlanCache(const SecretShare::Scheme &scheme, std::span<const uint8_t> points)
+        : scheme_(scheme), points_(points.begin(), points.end()) {}
+
+    const Plan &plan(const Subset &subset) {
+      std::lock_guard lock(mutex_);
+      auto it = plans_.find(subset);
+      if (it == plans_.end()) {
+        std::vector<uint8_t> points;
+        for (auto i{0u}; i < points_.size(); i++)
+          if (subset[i]) points.push_back(points_[i]);
+        auto plan = points.size() == scheme_.k() ? scheme_.joinPlan(points) : scheme_.decodePlan(points);
+        it = plans_.emplace(subset, std::move(plan)).first;
+      }
+      return it->second;
+    }
+
+   private:
+    const SecretShare::Scheme &scheme_;
+    std::vector<uint8_t> points_;
+    std::mutex mutex_;
+    std::unordered_map<Subset, Plan> plans_;
+  };
+
+  // For a join given more than k shares, which works round damage chunk by chunk. A chunk's good
+  // shares are those that could be read and, for containers, pass their checksums. When the first k
+  // good ones are containers they are simply joined, and the rest not even checked. Raw shares have
+  // nothing to vouch for them, so with more than k good ones all of those are decoded
+  // (Scheme::decode), correcting wrong shares, with check buffers from a scratch arena of the
+  // worker's own. Counts, for each share, the chunks it was left out of and the bytes in which it
+  // was wrong, and keeps the runs of bytes with too many wrong shares to correct, which are left as
+  // the first k shares join them, with the shares that were decoded there
+  class DecodeWorker {
+   public:
+    // bytes [first, last), counted from where the worker's first chunk starts, at which the shares at
+    // these positions disagreed past fixing
+    struct Uncorrectable {
+      std::uintmax_t first;
+      std::uintmax_t last;
+      std::vector<unsigned> shares;
+    };
+
+    DecodeWorker(const SecretShare::Scheme &scheme, PlanCache &plans,
+                 std::span<const FileOperations::ShareFile> files, std::uintmax_t first, std::size_t bufsize)
+        : scheme_(scheme),
+          plans_(plans),
+          files_(files),
+          first_(first),
+          bufsize_(bufsize),
+          arena_((files.size() - scheme.k() + 1) * (bufsize + Arena::alignment)),
+          skipped_(files.size()),
+          errors_(files.size()) {
+      for (auto i = scheme.k(); i < files.size(); i++)
+        checks_.emplace_back(static_cast<uint8_t *>(arena_.allocate(bufsize, Arena::alignment)), bufsize);
+    }
+
+    void operator()(PipelineChunk &chunk, std::uintmax_t n) {
+      auto k = scheme_.k();
+      good_.clear();
+      inputs_.clear();
+      auto vouched = true;
+
+      for (auto i{0u}; i < files_.size() && !(vouched && good_.size() == k); i++) {
+        auto in = chunk.inputs[i].first(chunk.len);
+        if (chunk.unread[i] || (files_[i].container() && FileOperations::crc32c(in) != chunk.crcs[i])) {
+          skipped_[i]++;
+          continue;
+        }
+        good_.push_back(i);
+        inputs_.push_back(in);
+        vouched = vouched && files_[i].container();
+      }
+      if (good_.size() < k)
+        throw std::system_error(EBADMSG, std::generic_category(),
+                                std::format("chunk {}: only {} shares are intact there, and {} are needed",
+                                            first_ + n, good_.size(), k));
+
+      PlanCache::Subset subset;
+      for (auto i : good_) subset.set(i);
+      auto &plan = plans_.plan(subset);
+      auto output = chunk.outputs[0].first(chunk.len);
+
+      if (good_.size() == k) {
+        const std::array<std::span<uint8_t>, 1> outputs{output};
+        scheme_.evaluate(plan, inputs_, outputs);
+        return;
+      }
 
+      wrong_.assign(good_.size(), 0);
+      runs_.clear();
+      scheme_.decode(plan, inputs_, output, std::span(checks_).first(good_.size() - k), wrong_, &runs_);
+      for (auto j{0u}; j < good_.size(); j++) errors_[good_[j]] += wrong_[j];
+      auto position = n * bufsize_;
+      for (auto [from, to] : runs_) uncorrectable_.push_back({position + from, position + to, good_});
+    }
+
+    // for each share, the chunks it was left out of, unreadable or damaged
+    std::span<const std::uintmax_t> skipped() const { return skipped_; }
+    // for each share, the bytes decoding found wrong
+    std::span<const std::uintmax_t> errors() const { return errors_; }
+    std::span<const Uncorrectable> uncorrectable() const { return uncorrectable_; }
+
+   private:
+    const SecretShare::Scheme &scheme_;
+    PlanCache &plans_;
+    std::span<const FileOperations::ShareFile> files_;
+    std::uintmax_t first_;
+    std::size_t bufsize_;
+    Arena arena_;
+    std::vector<std::span<uint8_t>> checks_;
+    std::vector<std::uintmax_t> skipped_;
+    std::vector<std::uintmax_t> errors_;
+    std::vector<std::uintmax_t> wrong_;
+    std::vector<unsigned> good_;
+    std::vector<std::span<const uint8_t>> inputs_;
+    std::vector<std::pair<std::size_t, std::size_t>> runs_;
+    std::vector<Uncorrectable> uncorrectable_;
+  };
+
+  // Split a file through a reader / compute / writer pipeline: this thread reads chunks, `threads`
+  // workers share them, and the writers store the m outputs of each chunk at its offset, so the
+  // disk and all the cores are kept busy at the same time. There is a writer for each device the
+  // shares go to, writing only the shares on that device, so the devices run in parallel. With
+  // `container` each share is written in a checksummed container rather than raw
+  static void splitFile(const fs::path &filepath, const CommandLine::SharePaths &paths, std::uintmax_t fsize,
+                        std::size_t m, std::size_t k, unsigned threads, bool direct, bool container = false) {
+    using FileOperations::DirectFile;
+    using FileOperations::ShareFile;
+    using FileOperations::ShareHeader;
+
+    threads = std::max(threads, 1u);
+    DirectFile input;
+    std::vector<ShareFile> shares;
+    std::vector<dev_t> devices;
+    std::vector<std::vector<unsigned>> deviceShares;
+
+    auto shareDevices = [&] {
+      for (auto i{0u}; i < shares.size(); i++) {
+        auto device = shares[i].device();
+        auto d = std::ranges::find(devices, device) - devices.begin();
+        if (d == std::ssize(devices)) {
+          devices.push_back(device);
+          deviceShares.emplace_back();
+        }
+        deviceShares[d].push_back(i);
+      }
+    };
+
+    // the shares' devices decide the number of writers, and so the chunk size, which a container
+    // header records; so they are opened first and the headers written afterwards
     try {
-      input = std::make_shared_for_overwrite<uint8_t[]>(fsize);
-    } catch (const std::bad_alloc &e) {
-      std::println("Can't allocate input buffer: {}", e.what());
+      input = DirectFile(filepath, O_RDONLY, direct);
+      for (auto ix{1u}; ix <= m; ix++)
+        shares.push_back(ShareFile::create(paths.path(filepath, ix), std::nullopt, direct));
+      shareDevices();
+    } catch (const std::system_error &e) {
+      std::println("Can't open files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
       throw;
     }
 
-    {  // RAII
-      std::ifstream infile;
-      infile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    auto writers = static_cast<unsigned>(devices.size());
+    auto [poolSize, bufsize, workerCount] = pipelineShape(fsize, m + 1, threads, writers);
+    threads = workerCount;
+
+    if (container) {
+      ShareHeader header;
+      header.m = static_cast<uint8_t>(m);
+      header.k = static_cast<uint8_t>(k);
+      header.length = fsize;
+      header.chunkSize = static_cast<uint32_t>(std::max<std::size_t>(bufsize, 1));
+      std::random_device rd;
+      header.setId = (static_cast<uint64_t>(rd()) << 32) | rd();
+
       try {
-        infile.open(filepath.c_str(), std::ios::in | std::ifstream::binary);
-      } catch (const std::ifstream::failure &e) {
-        std::println("Can't open input file {}: {} ({}: {})", filepath.string(), e.what(), e.code().value(),
+        for (auto ix{1u}; ix <= m; ix++) {
+          header.share = static_cast<uint8_t>(ix);
+          shares[ix - 1] = ShareFile::create(paths.path(filepath, ix), header, direct);
+        }
+      } catch (const std::system_error &e) {
+        std::println("Can't write share headers: {} ({}: {})", e.what(), e.code().value(),
                      e.code().message());
         throw;
       }
+    }
+
+    Arena buffers(poolSize * (m + 1) * (bufsize + DirectFile::alignment));
+    std::vector<PipelineChunk> pool;
+    std::deque<SplitWorker> workers;
+
+    try {
+      pool = chunkPool(buffers, poolSize, 1, m, bufsize);
+      for (auto t{0u}; t < threads; t++) workers.emplace_back(m, k, bufsize, container);
+    } catch (const std::bad_alloc &e) {
+      std::println("Can't allocate buffers: {}", e.what());
+      throw;
+    }
+
+    auto chunks = bufsize ? (fsize + bufsize - 1) / bufsize : 0;
+
+    try {
+      Pipeline::run(
+          std::span(pool), chunks,
+          [&](PipelineChunk &chunk, std::uintmax_t n) {
+            chunk.len = static_cast<std::size_t>(std::min<std::uintmax_t>(bufsize, fsize - n * bufsize));
+            input.read(chunk.inputs[0].first(chunk.len), n * bufsize);
+            return true;
+          },
+          workers,
+          [&](PipelineChunk &chunk, std::uintmax_t n, unsigned device) {
+            for (auto i : deviceShares[device])
+              shares[i].writeChunk(n, bufsize, chunk.outputs[i].first(chunk.len), chunk.crcs[i]);
+          },
+          writers);
+    } catch (const std::system_error &e) {
+      std::println("Can't split {}: {} ({}: {})", filepath.string(), e.what(), e.code().value(),
+                   e.code().message());
+      throw;
+    }
+  }
+
+  // Open the shares to be joined, in inputs, with their numbers in inPoints. Containers among them
+  // are checked to hold the shares asked for, from the same split as each other, with no more than
+  // `shares` needed; their header is returned. A split may have been extended with derived shares
+  // since a container was written, so its m is only a lower bound. Given more than k shares, one
+  // that can't be opened, or doesn't match the split and length most of the others agree on, is
+  // left out with the reason printed, as long as k remain; otherwise it stops the join.
+  static std::optional<FileOperations::ShareHeader> openJoinShares(
+      const fs::path &filepath, const CommandLine::SharePaths &paths, std::size_t m, std::size_t k,
+      const std::set<uint> &shares, bool direct, std::vector<FileOperations::ShareFile> &inputs,
+      std::vector<uint8_t> &inPoints) {
+    using FileOperations::ShareFile;
+
+    auto spare = shares.size() > k;
+    auto mismatch = [](const ShareFile &file, const std::string &what) {
+      return std::system_error(EBADMSG, std::generic_category(),
+                               std::format("{}: {}", file.path().string(), what));
+    };
+    auto leaveOut = [&](uint share, const std::system_error &e) {
+      std::println("Leaving share {} out of the join: {}", share, e.what());
+    };
+    auto enough = [&](std::size_t usable) {
+      if (usable < k)
+        throw std::system_error(EBADMSG, std::generic_category(),
+                                std::format("only {} shares can be used, and {} are needed", usable, k));
+    };
+
+    std::vector<std::pair<uint, ShareFile>> opened;
+    for (auto share : shares) {
+      try {
+        ShareFile file(paths.path(filepath, share), O_RDONLY, direct);
+        if (auto &h = file.header()) {
+          if (h->share != share) throw mismatch(file, std::format("holds share {}", h->share));
+          if (h->m > m) throw mismatch(file, std::format("is one of {} shares", h->m));
+          if (h->k > shares.size()) throw mismatch(file, std::format("needs {} shares to join", h->k));
+        }
+        opened.emplace_back(share, std::move(file));
+      } catch (const std::system_error &e) {
+        if (!spare) throw;
+        leaveOut(share, e);
+      }
+    }
+
+    enough(opened.size());
+
+    // the split, and the length, that the most shares have
+    std::map<std::tuple<uint64_t, uint32_t, uint64_t>, std::size_t> splits;
+    std::map<uint64_t, std::size_t> lengths;
+    for (auto &[share, file] : opened) {
+      if (auto &h = file.header()) splits[{h->setId, h->chunkSize, h->length}]++;
+      lengths[file.length()]++;
+    }
+    auto most = [](auto &counts) {
+      return std::ranges::max_element(counts, {}, [](auto &count) { return count.second; })->first;
+    };
+    auto split = splits.empty() ? std::tuple<uint64_t, uint32_t, uint64_t>{} : most(splits);
+    auto length = most(lengths);
+
+    std::optional<FileOperations::ShareHeader> header;
+    for (auto &[share, file] : opened) {
+      try {
+        auto &h = file.header();
+        if (h && std::tuple(h->setId, h->chunkSize, h->length) != split)
+          throw mismatch(file, "is from a different split");
+        if (file.length() != length) throw mismatch(file, "differs in length from the others");
+        if (h) header = h;
+        inPoints.push_back(static_cast<uint8_t>(share));
+        inputs.push_back(std::move(file));
+      } catch (const std::system_error &e) {
+        if (!spare) throw;
+        leaveOut(share, e);
+      }
+    }
+    enough(inputs.size());
+    return header;
+  }
+
+  // Join raw shares, container shares or a mixture. Containers set the chunk size, are checked to be
+  // from the same split as each other and to be the shares they were asked for, and have every
+  // chunk verified before it is used; the first bad chunk stops the join.
+  //
+  // Each byte of the secret depends only on the same byte of the shares, so any range of it can be
+  // rebuilt from that range of the shares alone: `length` bytes from `offset` (to the end, by
+  // default) go to the output, and only those are read from raw shares. Containers are read in
+  // whole chunks, which their checksums cover.
+  //
+  // Given more than k shares (k from the containers' headers, if any), the join works round damage.
+  // Shares it can't use at all are left out first (openJoinShares); then (DecodeWorker) each chunk
+  // is joined from shares that can be read and pass their checksums there, and raw shares are
+  // decoded, correcting up to (n - k) / 2 wrong ones in every byte. What was wrong with which share
+  // is reported at the end.
+  static void joinFile(const fs::path &filepath, const CommandLine::SharePaths &paths, std::uintmax_t fsize,
+                       std::size_t m, std::size_t k, const std::set<uint> &shares, unsigned threads,
+                       bool direct, std::uintmax_t offset = 0,
+                       std::uintmax_t length = std::numeric_limits<std::uintmax_t>::max()) {
+    using FileOperations::DirectFile;
+    using FileOperations::ShareFile;
+
+    threads = std::max(threads, 1u);
+    std::vector<ShareFile> inputs;
+    std::vector<uint8_t> inPoints;
+    DirectFile output;
+    std::optional<FileOperations::ShareHeader> header;
+
+    try {
+      header = openJoinShares(filepath, paths, m, k, shares, direct, inputs, inPoints);
+      output = DirectFile(std::format("{}.out", filepath.string()), O_WRONLY | O_CREAT | O_TRUNC, direct);
+    } catch (const std::system_error &e) {
+      std::println("Can't open files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
+
+    if (offset > fsize) {
+      std::println("Can't join {}: offset {} is past the end of the {} byte secret", filepath.string(),
+                   offset, fsize);
+      throw std::invalid_argument("offset past the end");
+    }
+    auto end = offset + std::min(length, fsize - offset);
+
+    // the shares that could be used
+    auto n = inputs.size();
+    if (header) k = header->k;
+    auto decoding = n > k;
+    SecretShare::Scheme scheme(m, decoding ? k : n);
+    auto plan = scheme.joinPlan(inPoints);
+    auto [poolSize, bufsize, workerCount] =
+        pipelineShape(end - offset, n + 1, threads, 1, header ? header->chunkSize : 0);
+    threads = workerCount;
+    // where the first chunk starts in the shares, and how far it may run
+    auto start = header ? offset / bufsize * bufsize : offset;
+    auto limit = header ? fsize : end;
+    auto first = bufsize ? start / bufsize : 0;
+
+    Arena buffers(poolSize * (n + 1) * (bufsize + DirectFile::alignment));
+    std::vector<PipelineChunk> pool;
+    std::deque<JoinWorker> joiners;
+    std::deque<DecodeWorker> decoders;
+    PlanCache plans(scheme, inPoints);
+
+    try {
+      pool = chunkPool(buffers, poolSize, n, 1, bufsize);
+      for (auto t{0u}; t < threads; t++) {
+        if (decoding)
+          decoders.emplace_back(scheme, plans, inputs, first, bufsize);
+        else
+          joiners.emplace_back(scheme, plan, inputs, first);
+      }
+    } catch (const std::bad_alloc &e) {
+      std::println("Can't allocate buffers: {}", e.what());
+      throw;
+    }
 
-      infile.read(std::bit_cast<char *>(input.get()), fsize);
+    auto chunks = bufsize && end > offset ? (end - start + bufsize - 1) / bufsize : 0;
+    auto join = [&](auto &workers) {
+      Pipeline::run(
+          std::span(pool), chunks,
+          [&](PipelineChunk &chunk, std::uintmax_t c) {
+            auto position = start + c * bufsize;
+            chunk.len = static_cast<std::size_t>(std::min<std::uintmax_t>(bufsize, limit - position));
+            for (auto i{0u}; i < n; i++) {
+              // with shares to spare, one that can't be read here is left out of this chunk
+              try {
+                chunk.crcs[i] = inputs[i].read(position, chunk.inputs[i].first(chunk.len));
+                chunk.unread[i] = false;
+              } catch (const std::system_error &) {
+                if (!decoding) throw;
+                chunk.unread[i] = true;
+              }
+            }
+            return true;
+          },
+          workers,
+          [&](PipelineChunk &chunk, std::uintmax_t c, unsigned) {
+            auto position = start + c * bufsize;
+            auto from = std::max(position, offset);
+            auto to = std::min(position + chunk.len, end);
+            output.write(chunk.outputs[0].subspan(from - position, to - from), from - offset);
+          },
+          1);
+    };
+
+    try {
+      if (decoding)
+        join(decoders);
+      else
+        join(joiners);
+    } catch (const std::system_error &e) {
+      std::println("Can't join {}: {} ({}: {})", filepath.string(), e.what(), e.code().value(),
+                   e.code().message());
+      throw;
     }
 
-    std::vector<std::shared_ptr<uint8_t[]>> outputs;
+    for (auto i{0u}; i < n && decoding; i++) {
+      std::uintmax_t skipped = 0;
+      std::uintmax_t wrong = 0;
+      for (auto &worker : decoders) {
+        skipped += worker.skipped()[i];
+        wrong += worker.errors()[i];
+      }
+      if (skipped)
+        std::println("Share {} was unreadable or damaged in {} chunks; they came from other shares",
+                     inPoints[i], skipped);
+      if (wrong) std::println("Share {} was wrong in {} bytes; they were corrected", inPoints[i], wrong);
+    }
+
+    // with one spare share a wrong one is only found, and with more, too many can be wrong at once;
+    // the join goes on, and what it could not vouch for is named
+    std::vector<DecodeWorker::Uncorrectable> uncorrectable;
+    for (auto &worker : decoders)
+      uncorrectable.insert(uncorrectable.end(), worker.uncorrectable().begin(), worker.uncorrectable().end());
+    std::ranges::sort(uncorrectable, {}, &DecodeWorker::Uncorrectable::first);
+    std::uintmax_t failed = 0;
+    for (auto &run : uncorrectable) {
+      auto from = std::max(start + run.first, offset);
+      auto to = std::min(start + run.last, end);
+      if (from >= to) continue;
+      std::string names;
+      for (auto i : run.shares) names += std::format("{}{}", names.empty() ? "" : " ", inPoints[i]);
+      std::println("Bytes {} to {} could not be corrected: shares {} disagree there, and too many are wrong",
+                   from, to - 1, names);
+      failed += to - from;
+    }
+    if (failed) {
+      std::println("Can't join {}: {} of its bytes may be wrong; leave out the damaged shares, or add more",
+                   filepath.string(), failed);
+      throw std::system_error(EBADMSG, std::generic_category(), "uncorrectable shares");
+    }
+  }
+
+  // Derive the shares at `points` from the k shares given: to recreate a share that was lost, or to
+  // issue more shares of the same split. The polynomial through the shares is evaluated at the new
+  // points (Scheme::derive) chunk by chunk, in one pass over the shares, and the secret is never
+  // formed, in memory or on disk. Each new share has a writer of its own. Containers give containers
+  // of the same split, recording m as the largest share number there now is.
+  static void deriveShares(const fs::path &filepath, const CommandLine::SharePaths &paths, std::size_t m,
+                           const std::set<uint> &shares, const std::set<uint> &points, unsigned threads,
+                           bool direct) {
+    using FileOperations::DirectFile;
+    using FileOperations::ShareFile;
+
+    threads = std::max(threads, 1u);
+    auto k = shares.size();
+    auto count = static_cast<unsigned>(points.size());
+    std::vector<ShareFile> inputs;
+    std::vector<uint8_t> inPoints;
+    std::vector<uint8_t> outPoints(points.begin(), points.end());
+    std::vector<ShareFile> outputs;
+    std::optional<FileOperations::ShareHeader> header;
+
+    try {
+      header = openJoinShares(filepath, paths, m, k, shares, direct, inputs, inPoints);
+    } catch (const std::system_error &e) {
+      std::println("Can't open files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
+
+    auto fsize = inputs.front().length();
+    auto [poolSize, bufsize, workerCount] =
+        pipelineShape(fsize, k + count, threads, count, header ? header->chunkSize : 0);
+    threads = workerCount;
+    if (header) header->m = static_cast<uint8_t>(m);
+
+    try {
+      for (auto p : outPoints) {
+        if (header) header->share = p;
+        outputs.push_back(ShareFile::create(paths.path(filepath, p), header, direct));
+      }
+    } catch (const std::system_error &e) {
+      std::println("Can't create shares: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
 
     SecretShare::Scheme scheme(m, k);
+    auto plan = scheme.derivePlan(inPoints, outPoints);
+    Arena buffers(poolSize * (k + count) * (bufsize + DirectFile::alignment));
+    std::vector<PipelineChunk> pool;
+    std::deque<JoinWorker> workers;
 
-    scheme.split(input, fsize, outputs);
+    try {
+      pool = chunkPool(buffers, poolSize, k, count, bufsize);
+      for (auto t{0u}; t < threads; t++) workers.emplace_back(scheme, plan, inputs, 0, header.has_value());
+    } catch (const std::bad_alloc &e) {
+      std::println("Can't allocate buffers: {}", e.what());
+      throw;
+    }
+
+    auto chunks = bufsize ? (fsize + bufsize - 1) / bufsize : 0;
+
+    try {
+      Pipeline::run(
+          std::span(pool), chunks,
+          [&](PipelineChunk &chunk, std::uintmax_t n) {
+            chunk.len = static_cast<std::size_t>(std::min<std::uintmax_t>(bufsize, fsize - n * bufsize));
+            for (auto i{0u}; i < k; i++)
+              chunk.crcs[i] = inputs[i].read(n * bufsize, chunk.inputs[i].first(chunk.len));
+            return true;
+          },
+          workers,
+          [&](PipelineChunk &chunk, std::uintmax_t n, unsigned share) {
+            outputs[share].writeChunk(n, bufsize, chunk.outputs[share].first(chunk.len), chunk.crcs[share]);
+          },
+          count);
+    } catch (const std::system_error &e) {
+      std::println("Can't derive shares of {}: {} ({}: {})", filepath.string(), e.what(), e.code().value(),
+                   e.code().message());
+      throw;
+    }
+  }
+
+  // Split a stream of unknown length, standard input ("-") or a pipe, into shares that may be pipes
+  // or FIFOs themselves. Streams have no offsets, so everything moves strictly in order: a single
+  // worker, and a writer per share, so a slow reader of one share does not hold up the others until
+  // the pool runs dry. Messages go to stderr, as stdout may be carrying data.
+  static void splitStream(const fs::path &filepath, const CommandLine::SharePaths &paths, std::size_t m,
+                          std::size_t k) {
+    using FileOperations::FileDescriptor;
+
+    FileDescriptor input;
+    std::vector<FileDescriptor> shares;
+
+    try {
+      if (filepath != "-") input = FileDescriptor(filepath, O_RDONLY);
+      for (auto ix{1u}; ix <= m; ix++)
+        shares.emplace_back(paths.path(filepath, ix), O_WRONLY | O_CREAT | O_TRUNC);
+    } catch (const std::system_error &e) {
+      std::println(stderr, "Can't open files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
+
+    auto in = filepath == "-" ? STDIN_FILENO : input.get();
+    auto writers = static_cast<unsigned>(m);
+    auto [poolSize, bufsize, workerCount] =
+        pipelineShape(std::numeric_limits<std::uintmax_t>::max(), m + 1, 1, writers);
+
+    Arena buffers(poolSize * (m + 1) * (bufsize + FileOperations::DirectFile::alignment));
+    std::vector<PipelineChunk> pool;
+    std::deque<SplitWorker> workers;
+
+    try {
+      pool = chunkPool(buffers, poolSize, 1, m, bufsize);
+      workers.emplace_back(m, k, bufsize);
+    } catch (const std::bad_alloc &e) {
+      std::println(stderr, "Can't allocate buffers: {}", e.what());
+      throw;
+    }
 
-    auto ix{1u};
-    for (auto &&o : outputs) {
-      auto sharename = std::format("{}_{}.dat", filepath.string(), ix++);
-      std::ofstream share(sharename, std::ofstream::binary);
-      share.write(std::bit_cast<char *>(o.get()), fsize);
+    try {
+      Pipeline::run(
+          std::span(pool), std::numeric_limits<std::uintmax_t>::max(),
+          [&](PipelineChunk &chunk, std::uintmax_t) {
+            chunk.len = FileOperations::readFull(in, chunk.inputs[0]);
+            return chunk.len > 0;
+          },
+          workers,
+          [&](PipelineChunk &chunk, std::uintmax_t, unsigned share) {
+            FileOperations::writeAll(shares[share].get(), chunk.outputs[share].first(chunk.len));
+          },
+          writers);
+    } catch (const std::system_error &e) {
+      std::println(stderr, "Can't split {}: {} ({}: {})", filepath.string(), e.what(), e.code().value(),
+                   e.code().message());
+      throw;
     }
   }
 
-  static void joinFile(const fs::path &filepath, std::uintmax_t fsize, std::size_t m,
-                       const std::set<uint> &shares) {
-    std::vector<std::shared_ptr<uint8_t[]>> inputs;
+  // Join shares that may be pipes or FIFOs, to standard output ("-") or a file. When standard output
+  // is a pipe the secret is never copied into it: each chunk is computed into fresh pages that are
+  // then given to the pipe with vmsplice, so the plaintext goes to the reader without touching disk.
+  static void joinStream(const fs::path &filepath, const CommandLine::SharePaths &paths, std::size_t m,
+                         const std::set<uint> &shares) {
+    using FileOperations::FileDescriptor;
+
+    auto k = shares.size();
+    std::vector<FileDescriptor> inputs;
     std::vector<uint8_t> inPoints;
-    inPoints.reserve(shares.size());
+    FileDescriptor output;
 
-    for (auto share : shares) {
-      inPoints.push_back(share);
-      auto sharename = std::format("{}_{}.dat", filepath.string(), share);
+    try {
+      for (auto share : shares) {
+        inPoints.push_back(share);
+        inputs.emplace_back(paths.path(filepath, share), O_RDONLY);
+      }
+      if (filepath != "-")
+        output = FileDescriptor(std::format("{}.out", filepath.string()), O_WRONLY | O_CREAT | O_TRUNC);
+    } catch (const std::system_error &e) {
+      std::println(stderr, "Can't open files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
 
-      std::ifstream infile;
+    auto out = filepath == "-" ? STDOUT_FILENO : output.get();
+    struct stat st;
+    auto gift = fstat(out, &st) == 0 && S_ISFIFO(st.st_mode);
 
-      infile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-      try {
-        infile.open(sharename, std::ifstream::binary);
-      } catch (const std::ifstream::failure &e) {
-        std::println("Can't open input file {}: {} ({}: {})", sharename, e.what(), e.code().value(),
-                     e.code().message());
-        throw;
+    SecretShare::Scheme scheme(m, k);
+    auto plan = scheme.joinPlan(inPoints);
+    auto [poolSize, bufsize, workerCount] =
+        pipelineShape(std::numeric_limits<std::uintmax_t>::max(), k + 1, 1, 1);
+
+    Arena buffers(poolSize * (k + 1) * (bufsize + FileOperations::DirectFile::alignment));
+    std::vector<PipelineChunk> pool;
+    std::deque<JoinWorker> workers;
+
+    try {
+      pool = chunkPool(buffers, poolSize, k, 1, bufsize);
+      workers.emplace_back(scheme, plan);
+    } catch (const std::bad_alloc &e) {
+      std::println(stderr, "Can't allocate buffers: {}", e.what());
+      throw;
+    }
+
+    try {
+      Pipeline::run(
+          std::span(pool), std::numeric_limits<std::uintmax_t>::max(),
+          [&](PipelineChunk &chunk, std::uintmax_t) {
+            chunk.len = FileOperations::readFull(inputs[0].get(), chunk.inputs[0]);
+            for (auto i{1u}; i < k; i++)
+              if (FileOperations::readFull(inputs[i].get(), chunk.inputs[i]) != chunk.len)
+                throw std::system_error(EINVAL, std::generic_category(), "Shares have differing lengths");
+            if (gift && chunk.len) {
+              chunk.pages = FileOperations::Pages(chunk.len);
+              chunk.outputs[0] = chunk.pages.data();
+            }
+            return chunk.len > 0;
+          },
+          workers,
+          [&](PipelineChunk &chunk, std::uintmax_t, unsigned) {
+            if (!gift || !FileOperations::giftToPipe(out, chunk.pages, chunk.len))
+              FileOperations::writeAll(out, chunk.outputs[0].first(chunk.len));
+          },
+          1);
+    } catch (const std::system_error &e) {
+      std::println(stderr, "Can't join {}: {} ({}: {})", filepath.string(), e.what(), e.code().value(),
+                   e.code().message());
+      throw;
+    }
+  }
+
+  // With k = 1 the polynomial is a constant and every share is a byte-for-byte copy of the secret,
+  // so there is nothing to compute: the shares are made as reflinks or in-kernel copies of the input
+  static void splitFileCopies(const fs::path &filepath, const CommandLine::SharePaths &paths,
+                              std::uintmax_t fsize, std::size_t m) {
+    using FileOperations::FileDescriptor;
+
+    try {
+      FileDescriptor input(filepath, O_RDONLY);
+      for (auto ix{1u}; ix <= m; ix++) {
+        FileDescriptor output(paths.path(filepath, ix), O_WRONLY | O_CREAT | O_TRUNC);
+        FileOperations::copyFile(input.get(), output.get(), fsize);
       }
-      std::shared_ptr<uint8_t[]> input;
-      try {
-        input = std::make_shared_for_overwrite<uint8_t[]>(fsize);
-      } catch (std::bad_alloc &e) {
-        std::println("Can't allocate input buffer: {}", e.what());
-        throw;
+    } catch (const std::system_error &e) {
+      std::println("Can't copy {}: {} ({}: {})", filepath.string(), e.what(), e.code().value(),
+                   e.code().message());
+      throw;
+    }
+  }
+
+  // and likewise a join from a single share is a copy of it
+  static void joinFileCopy(const fs::path &filepath, const CommandLine::SharePaths &paths,
+                           std::uintmax_t fsize, uint share) {
+    using FileOperations::FileDescriptor;
+
+    try {
+      FileDescriptor input(paths.path(filepath, share), O_RDONLY);
+      FileDescriptor output(std::format("{}.out", filepath.string()), O_WRONLY | O_CREAT | O_TRUNC);
+      FileOperations::copyFile(input.get(), output.get(), fsize);
+    } catch (const std::system_error &e) {
+      std::println("Can't copy {}: {} ({}: {})", filepath.string(), e.what(), e.code().value(),
+                   e.code().message());
+      throw;
+    }
+  }
+
+  // How many bytes of the input the shares of an appending split are known to hold, kept next to
+  // the first share. The record only moves on once every share has the new bytes on disk, and is
+  // replaced by a rename, so after a crash it never claims more than all the shares have.
+  static fs::path appendRecord(const fs::path &filepath, const CommandLine::SharePaths &paths) {
+    return paths.path(filepath, 1).string() + ".appended";
+  }
+
+  static std::optional<std::uintmax_t> readAppendRecord(const fs::path &record) {
+    std::ifstream in(record);
+    std::uintmax_t offset;
+    if (in >> offset) return offset;
+    return std::nullopt;
+  }
+
+  static void writeAppendRecord(const fs::path &record, std::uintmax_t offset) {
+    using FileOperations::FileDescriptor;
+
+    auto temp = record.string() + ".tmp";
+    {
+      FileDescriptor f(temp, O_WRONLY | O_CREAT | O_TRUNC);
+      auto text = std::format("{}\n", offset);
+      FileOperations::writeAll(f.get(), {reinterpret_cast<const uint8_t *>(text.data()), text.size()});
+      if (fsync(f.get()) < 0) throw std::system_error(errno, std::generic_category(), "fsync");
+    }
+    if (rename(temp.c_str(), record.c_str()) < 0)
+      throw std::system_error(errno, std::generic_category(),
+                              std::format("Can't replace {}", record.string()));
+    FileOperations::syncDirectory(record.parent_path());
+  }
+
+  // Split only what has been added to a growing file since last time, and append it to the shares:
+  // share bytes depend only on the secret bytes at the same offset, so the new tail can be shared on
+  // its own, with fresh randomness. Shares left longer by a crashed run are cut back to the append
+  // record first, which makes them consistent again. With `follow` it carries on, woken by inotify
+  // whenever the file changes, until the file is deleted or moved away (rotated).
+  //
+  // Raw shares do not record their scheme, so m and k must be the ones the shares were made with.
+  static void splitFileAppend(const fs::path &filepath, const CommandLine::SharePaths &paths, std::size_t m,
+                              std::size_t k, bool follow) {
+    using FileOperations::FileDescriptor;
+
+    FileDescriptor input;
+    FileDescriptor watch;
+    std::vector<FileDescriptor> shares;
+    auto record = appendRecord(filepath, paths);
+    std::uintmax_t committed;
+
+    try {
+      input = FileDescriptor(filepath, O_RDONLY);
+      // watched before anything is read, so that no change can slip by unnoticed
+      if (follow) {
+        watch = FileDescriptor(inotify_init1(IN_CLOEXEC));
+        if (watch.get() < 0) throw std::system_error(errno, std::generic_category(), "inotify_init1");
+        if (inotify_add_watch(watch.get(), filepath.c_str(), IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF) < 0)
+          throw std::system_error(errno, std::generic_category(),
+                                  std::format("Can't watch {}", filepath.string()));
+      }
+
+      std::vector<std::uintmax_t> lengths;
+      for (auto ix{1u}; ix <= m; ix++) {
+        shares.emplace_back(paths.path(filepath, ix), O_RDWR | O_CREAT);
+        lengths.push_back(fs::file_size(paths.path(filepath, ix)));
+      }
+
+      // without a record the shares are new, or from a plain split and all the same length
+      auto recorded = readAppendRecord(record);
+      committed = recorded.value_or(std::ranges::min(lengths));
+      for (auto i{0u}; i < m; i++) {
+        if (lengths[i] < committed)
+          throw std::system_error(EBADMSG, std::generic_category(),
+                                  std::format("{} is shorter than the {} bytes already split",
+                                              paths.path(filepath, i + 1).string(), committed));
+        if (lengths[i] > committed && ftruncate(shares[i].get(), static_cast<off_t>(committed)) < 0)
+          throw std::system_error(errno, std::generic_category(), "ftruncate");
+      }
+      if (!recorded) writeAppendRecord(record, committed);
+    } catch (const std::system_error &e) {
+      std::println("Can't open files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
+
+    Arena buffers((m + 1) * (chunkSize + FileOperations::DirectFile::alignment));
+    auto chunk = std::move(chunkPool(buffers, 1, 1, m, chunkSize).front());
+    SplitWorker worker(m, k, chunkSize);
+
+    // share whatever is new, and say whether the file still has a name: deleting a file that is open
+    // here only drops its link count
+    auto appendTail = [&] {
+      struct stat st;
+      if (fstat(input.get(), &st) < 0) throw std::system_error(errno, std::generic_category(), "fstat");
+      auto fsize = static_cast<std::uintmax_t>(st.st_size);
+      if (fsize < committed)
+        throw std::system_error(EBADMSG, std::generic_category(),
+                                std::format("{} is shorter than the {} bytes already split",
+                                            filepath.string(), committed));
+      if (fsize == committed) return st.st_nlink > 0;
+
+      for (auto offset = committed; offset < fsize; offset += chunkSize) {
+        chunk.len = static_cast<std::size_t>(std::min<std::uintmax_t>(chunkSize, fsize - offset));
+        FileOperations::readAt(input.get(), chunk.inputs[0].first(chunk.len), offset);
+        worker(chunk, 0);
+        for (auto i{0u}; i < m; i++)
+          FileOperations::writeAt(shares[i].get(), chunk.outputs[i].first(chunk.len), offset);
+      }
+      for (auto &share : shares)
+        if (fdatasync(share.get()) < 0)
+          throw std::system_error(errno, std::generic_category(), "fdatasync");
+      committed = fsize;
+      writeAppendRecord(record, committed);
+      return st.st_nlink > 0;
+    };
+
+    try {
+      appendTail();
+
+      alignas(inotify_event) std::array<char, 4096> events;
+      for (auto gone = !follow; !gone;) {
+        auto r = read(watch.get(), events.data(), events.size());
+        if (r < 0) {
+          if (errno == EINTR) continue;
+          throw std::system_error(errno, std::generic_category(), "inotify");
+        }
+        for (auto p = events.data(); p < events.data() + r;) {
+          auto event = reinterpret_cast<const inotify_event *>(p);
+          if (event->mask & (IN_MOVE_SELF | IN_IGNORED)) gone = true;
+          p += sizeof(inotify_event) + event->len;
+        }
+        // a file moved or deleted away can still be read to its last byte through the descriptor
+        if (!appendTail()) gone = true;
+      }
+    } catch (const std::system_error &e) {
+      std::println("Can't append {}: {} ({}: {})", filepath.string(), e.what(), e.code().value(),
+                   e.code().message());
+      throw;
+    }
+  }
+
+  // The start of a file, len bytes of it, joined from as many of files as the scheme's threshold,
+  // taken to be the shares numbered from `first` on
+  static std::vector<uint8_t> joinStart(SecretShare::Scheme &scheme,
+                                        std::span<FileOperations::ShareFile> files, std::size_t first,
+                                        std::size_t len) {
+    std::vector<std::vector<uint8_t>> buffers;
+    std::vector<std::span<const uint8_t>> inputs;
+    std::vector<uint8_t> points;
+    for (auto i{0u}; i < scheme.k(); i++) {
+      auto &b = buffers.emplace_back(len);
+      files[i].read(0, b);
+      inputs.push_back(b);
+      points.push_back(static_cast<uint8_t>(first + i));
+    }
+    std::vector<uint8_t> joined(len);
+    scheme.join(inputs, points, joined);
+    return joined;
+  }
+
+  // Check that shares, all m of them in order, are a split of threshold k, before they are
+  // rewritten. A raw share doesn't record its split, and rewriting with the wrong m or k leaves
+  // shares of something else: so there must be no share m + 1, and over the first len bytes k of
+  // the shares agree with the next k, and k - 1 of them do not with the next k - 1
+  static void checkSplit(const fs::path &filepath, const CommandLine::SharePaths &paths, std::size_t m,
+                         std::size_t k, std::span<FileOperations::ShareFile> shares, std::size_t len) {
+    if (!paths.listed() && fs::exists(paths.path(filepath, m + 1)))
+      throw std::system_error(EEXIST, std::generic_category(),
+                              std::format("{} is share {}", paths.path(filepath, m + 1).string(), m + 1));
+    if (!len) return;
+
+    SecretShare::Scheme scheme(m, k);
+    if (m > k && joinStart(scheme, shares, 1, len) != joinStart(scheme, shares.subspan(1), 2, len))
+      throw std::system_error(EBADMSG, std::generic_category(),
+                              std::format("shares 1 to {} disagree; is the threshold above {}?", k + 1, k));
+    if (k > 1) {
+      SecretShare::Scheme fewer(m, k - 1);
+      if (joinStart(fewer, shares, 1, len) == joinStart(fewer, shares.subspan(1), 2, len))
+        throw std::system_error(EBADMSG, std::generic_category(),
+                                std::format("{} shares are enough; is the threshold below {}?", k - 1, k));
+    }
+  }
+
+  // Bring the shares of a file up to date with an edit of it that keeps its length, patching them
+  // in place (Scheme::applyDelta) only where the old and new versions differ, and leaving alone the
+  // shares that hold just random values. Raw shares are read and written over the changed bytes
+  // alone; containers a chunk at a time, each checked before and checksummed again after. Every
+  // share is needed. The shares are patched one after another, so an update that is cut short
+  // leaves them disagreeing about the changed bytes, and the file has to be split again. Raw shares
+  // are checked against m and k first (checkSplit), as a wrong one would patch them into nonsense.
+  static void updateShares(const fs::path &filepath, const fs::path &oldpath,
+                           const CommandLine::SharePaths &paths, std::size_t m, std::size_t k) {
+    using FileOperations::FileDescriptor;
+    using FileOperations::ShareFile;
+
+    FileDescriptor current;
+    FileDescriptor previous;
+    std::vector<ShareFile> shares;
+    std::uintmax_t fsize;
+    std::size_t bufsize = 64 * 1024;
+
+    try {
+      current = FileDescriptor(filepath, O_RDONLY);
+      previous = FileDescriptor(oldpath, O_RDONLY);
+      fsize = fs::file_size(filepath);
+      if (fs::file_size(oldpath) != fsize)
+        throw std::system_error(EINVAL, std::generic_category(),
+                                std::format("{} and {} differ in length; split the new one again",
+                                            oldpath.string(), filepath.string()));
+
+      std::optional<FileOperations::ShareHeader> header;
+      for (auto ix{1u}; ix <= m; ix++) {
+        shares.emplace_back(paths.path(filepath, ix), O_RDWR);
+        auto &h = shares.back().header();
+        auto mismatch = [&](const std::string &what) {
+          return std::system_error(EBADMSG, std::generic_category(),
+                                   std::format("{}: {}", shares.back().path().string(), what));
+        };
+        if (shares.back().length() != fsize)
+          throw mismatch(std::format("is not a share of {}", oldpath.string()));
+        if (!h) continue;
+        if (h->share != ix || h->m > m || h->k != k)
+          throw mismatch(std::format("is not share {} of {} with threshold {}", ix, m, k));
+        if (header && (h->setId != header->setId || h->chunkSize != header->chunkSize))
+          throw mismatch("is from a different split");
+        header = h;
+        bufsize = h->chunkSize;
+      }
+      checkSplit(filepath, paths, m, k, shares,
+                 static_cast<std::size_t>(std::min<std::uintmax_t>({fsize, bufsize, 64 * 1024})));
+    } catch (const std::system_error &e) {
+      std::println("Can't open files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
+
+    SecretShare::Scheme scheme(m, k);
+    auto &plan = scheme.splitPlan();
+    auto delta = scheme.allocate(bufsize);
+    auto edited = scheme.allocate(bufsize);
+    std::vector<std::span<uint8_t>> views;
+    std::vector<std::span<uint8_t>> buffers;
+    for (auto i{0u}; i < m; i++) buffers.push_back(scheme.allocate(bufsize));
+
+    try {
+      for (std::uintmax_t position = 0; position < fsize; position += bufsize) {
+        auto len = static_cast<std::size_t>(std::min<std::uintmax_t>(bufsize, fsize - position));
+        FileOperations::readAt(previous.get(), delta.first(len), position);
+        FileOperations::readAt(current.get(), edited.first(len), position);
+        for (auto ix{0u}; ix < len; ix++) delta[ix] ^= edited[ix];
+
+        // the changed bytes are [first, last) of this block
+        std::size_t first = 0, last = len;
+        while (first < len && !delta[first]) first++;
+        if (first == len) continue;
+        while (!delta[last - 1]) last--;
+
+        views.clear();
+        for (auto i{0u}; i < m; i++) {
+          views.push_back(buffers[i].first(len));
+          if (!plan.coefficient(i, 0)) continue;
+          if (!shares[i].container()) {
+            shares[i].read(position + first, views[i].subspan(first, last - first));
+            continue;
+          }
+          auto crc = shares[i].read(position, views[i]);
+          if (FileOperations::crc32c(views[i]) != crc) throw shares[i].corrupt(position / bufsize);
+        }
+
+        scheme.applyDelta(first, delta.subspan(first, last - first), views);
+
+        for (auto i{0u}; i < m; i++) {
+          if (!plan.coefficient(i, 0)) continue;
+          if (shares[i].container())
+            shares[i].write(position, views[i], FileOperations::crc32c(views[i]));
+          else
+            shares[i].write(position + first, views[i].subspan(first, last - first), 0);
+        }
+      }
+    } catch (const std::system_error &e) {
+      std::println("Can't update the shares of {}: {} ({}: {})", filepath.string(), e.what(),
+                   e.code().value(), e.code().message());
+      throw;
+    }
+  }
+
+  // Re-randomise the shares of a file without ever assembling it: each share has its part of a fresh
+  // random sharing of zero added to it (Scheme::refresh), and the secret they join to stays the same.
+  // The shares are done one at a time, each in a single sequential pass into a new file beside it;
+  // the random values for every chunk come from a key held only in memory, so each share's pass
+  // regenerates the ones the others used. Only when every new share is on disk, and the start of
+  // the file joins from k of them as it does from k of the old ones, do they replace the old ones,
+  // which no longer join with them: a raw share says nothing of its split, and a wrong -m or -k
+  // would otherwise leave shares of something else. Each share keeps its kind; refreshed
+  // containers get a new set id, so that an old share slipped in among new ones is caught. Every
+  // share is needed.
+  static void refreshShares(const fs::path &filepath, const CommandLine::SharePaths &paths, std::size_t m,
+                            std::size_t k) {
+    using FileOperations::ShareFile;
+
+    std::vector<ShareFile> shares;
+    std::vector<std::optional<FileOperations::ShareHeader>> headers;
+    std::optional<FileOperations::ShareHeader> header;
+    std::uintmax_t fsize = 0;
+
+    try {
+      for (auto ix{1u}; ix <= m; ix++) {
+        shares.emplace_back(paths.path(filepath, ix), O_RDONLY);
+        auto &h = shares.back().header();
+        auto mismatch = [&](const std::string &what) {
+          return std::system_error(EBADMSG, std::generic_category(),
+                                   std::format("{}: {}", shares.back().path().string(), what));
+        };
+        if (ix > 1 && shares.back().length() != fsize) throw mismatch("differs in length from share 1");
+        fsize = shares.back().length();
+        headers.push_back(h);
+        if (!h) continue;
+        if (h->share != ix || h->m > m || h->k != k)
+          throw mismatch(std::format("is not share {} of {} with threshold {}", ix, m, k));
+        if (header && (h->setId != header->setId || h->chunkSize != header->chunkSize))
+          throw mismatch("is from a different split");
+        header = h;
+      }
+    } catch (const std::system_error &e) {
+      std::println("Can't open files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
+
+    std::size_t bufsize = header ? header->chunkSize : chunkSize;
+    auto key = SecretShare::RandomSource::key();
+    std::random_device rd;
+    auto setId = (static_cast<uint64_t>(rd()) << 32) | rd();
+    for (auto ix{1u}; ix <= m; ix++) {
+      auto &h = headers[ix - 1];
+      if (!h) continue;
+      h->setId = setId;
+      h->m = static_cast<uint8_t>(m);
+      h->share = static_cast<uint8_t>(ix);
+    }
+
+    SecretShare::Scheme scheme(m, k);
+    auto buffer = scheme.allocate(bufsize);
+    auto ranbuf = scheme.allocate((k - 1) * bufsize);
+    std::vector<fs::path> refreshed;
+    auto replacing = false;
+    auto len = static_cast<std::size_t>(std::min<std::uintmax_t>({fsize, bufsize, 64 * 1024}));
+
+    try {
+      checkSplit(filepath, paths, m, k, shares, len);
+
+      for (auto ix{1u}; ix <= m; ix++) {
+        auto &share = shares[ix - 1];
+        refreshed.push_back(share.path().string() + ".refresh");
+        auto out = ShareFile::create(refreshed.back(), headers[ix - 1]);
+
+        for (std::uintmax_t position = 0; position < fsize; position += bufsize) {
+          auto len = static_cast<std::size_t>(std::min<std::uintmax_t>(bufsize, fsize - position));
+          auto in = buffer.first(len);
+          auto crc = share.read(position, in);
+          if (share.container() && FileOperations::crc32c(in) != crc)
+            throw share.corrupt(position / bufsize);
+
+          SecretShare::RandomSource(key, position / bufsize).fill(ranbuf.first((k - 1) * len));
+          scheme.refresh(ranbuf.first((k - 1) * len), static_cast<uint8_t>(ix), in);
+
+          out.write(position, in, out.container() ? FileOperations::crc32c(in) : 0);
+        }
+        out.sync();
       }
-      infile.read(std::bit_cast<char *>(input.get()), fsize);
-      inputs.push_back(input);
-      infile.close();
+
+      // the new shares m-k+1..m must join to what the old 1..k do, before the old ones go
+      std::vector<ShareFile> checked;
+      for (auto ix = m - k + 1; ix <= m; ix++) checked.emplace_back(refreshed[ix - 1], O_RDONLY);
+      if (joinStart(scheme, shares, 1, len) != joinStart(scheme, checked, m - k + 1, len))
+        throw std::system_error(EBADMSG, std::generic_category(),
+                                std::format("the new shares join to something else; is it {} of {}?", k, m));
+
+      replacing = true;
+      for (auto i{0u}; i < m; i++) {
+        fs::rename(refreshed[i], shares[i].path());
+        FileOperations::syncDirectory(shares[i].path().parent_path());
+      }
+    } catch (const std::system_error &e) {
+      std::println("Can't refresh the shares of {}: {} ({}: {})", filepath.string(), e.what(),
+                   e.code().value(), e.code().message());
+      // the old shares are intact until the first rename; after it, the new ones are needed too
+      std::error_code ec;
+      if (!replacing)
+        for (auto &path : refreshed) fs::remove(path, ec);
+      throw;
+    }
+  }
+
+  // The same split, with the input and the share files mapped into memory: the kernel reads pages
+  // of the input and writes pages of the shares directly, and the page cache does the rest
+  static void splitFileMapped(const fs::path &filepath, const CommandLine::SharePaths &paths, std::size_t m,
+                              std::size_t k, bool hugePages) {
+    using FileOperations::MappedFile;
+
+    MappedFile input;
+    std::vector<MappedFile> shares;
+
+    try {
+      input = MappedFile::openRead(filepath);
+      input.adviseSequential();
+
+      for (auto ix{1u}; ix <= m; ix++) {
+        auto sharename = paths.path(filepath, ix);
+        shares.push_back(MappedFile::create(sharename, input.size()));
+        shares.back().adviseSequential();
+        if (hugePages) shares.back().adviseHugePages();
+      }
+    } catch (const std::system_error &e) {
+      std::println("Can't map files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
+
+    Arena arena((k - 1) * chunkSize + Arena::alignment * (k + m + 8));
+    SecretShare::Scheme scheme(m, k, &arena);
+    std::vector<std::span<uint8_t>> outputs;
+    auto fsize = input.size();
+
+    for (std::size_t offset = 0; offset < fsize; offset += chunkSize) {
+      auto len = std::min(chunkSize, fsize - offset);
+
+      outputs.clear();
+      for (auto &share : shares) outputs.push_back(share.data().subspan(offset, len));
+      scheme.split(input.data().subspan(offset, len), outputs);
+      arena.reset();
+    }
+  }
+
+  static void joinFileMapped(const fs::path &filepath, const CommandLine::SharePaths &paths, std::size_t m,
+                             const std::set<uint> &shares, bool hugePages) {
+    using FileOperations::MappedFile;
+
+    std::vector<MappedFile> inputs;
+    std::vector<uint8_t> inPoints;
+    MappedFile output;
+
+    try {
+      for (auto share : shares) {
+        inPoints.push_back(share);
+        auto sharename = paths.path(filepath, share);
+        inputs.push_back(MappedFile::openRead(sharename));
+        inputs.back().adviseSequential();
+      }
+
+      output = MappedFile::create(std::format("{}.out", filepath.string()), inputs.front().size());
+      output.adviseSequential();
+      if (hugePages) output.adviseHugePages();
+    } catch (const std::system_error &e) {
+      std::println("Can't map files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
     }
 
-    std::shared_ptr<uint8_t[]> output;
     SecretShare::Scheme scheme(m, shares.size());
+    auto plan = scheme.joinPlan(inPoints);
+    std::vector<std::span<const uint8_t>> chunks;
+    auto fsize = output.size();
+
+    for (std::size_t offset = 0; offset < fsize; offset += chunkSize) {
+      auto len = std::min(chunkSize, fsize - offset);
 
-    scheme.join(inputs, fsize, inPoints, std::move(output));
+      chunks.clear();
+      for (auto &in : inputs) chunks.push_back(in.data().subspan(offset, len));
+      scheme.join(plan, chunks, output.data().subspan(offset, len));
+    }
+  }
 
-    auto outputname = std::format("{}.out", filepath.string());
+  // The same split on an I/O engine, double-buffered: while chunk n is being computed the read of
+  // chunk n + 1 and the writes of chunk n - 1 are in flight, so the disk and the CPU overlap
+  static void splitFileAsync(const fs::path &filepath, const CommandLine::SharePaths &paths,
+                             std::uintmax_t fsize, std::size_t m, std::size_t k) {
+    using FileOperations::FileDescriptor;
 
-    std::ofstream outputfile(outputname, std::ofstream::binary);
-    outputfile.write(std::bit_cast<char *>(output.get()), fsize);
+    auto bufsize = static_cast<std::size_t>(std::min<std::uintmax_t>(fsize, chunkSize));
+    FileDescriptor input;
+    std::vector<FileDescriptor> shares;
+
+    try {
+      input = FileDescriptor(filepath, O_RDONLY);
+      for (auto ix{1u}; ix <= m; ix++)
+        shares.emplace_back(paths.path(filepath, ix), O_WRONLY | O_CREAT | O_TRUNC);
+    } catch (const std::system_error &e) {
+      std::println("Can't open files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
+
+    // two input buffers and two sets of m output buffers, in one pinned slab
+    Arena buffers(2 * (m + 1) * (bufsize + Arena::alignment));
+    std::array<std::span<uint8_t>, 2> inputs;
+    std::array<std::vector<std::span<uint8_t>>, 2> outputs;
+    std::vector<std::span<uint8_t>> all;
+    for (auto b{0u}; b < 2; b++) {
+      inputs[b] = {static_cast<uint8_t *>(buffers.allocate(bufsize)), bufsize};
+      all.push_back(inputs[b]);
+      for (auto i{0u}; i < m; i++) {
+        outputs[b].emplace_back(static_cast<uint8_t *>(buffers.allocate(bufsize)), bufsize);
+        all.push_back(outputs[b].back());
+      }
+    }
+
+    FileOperations::IoEngine engine(static_cast<unsigned>(2 * m + 2));
+    engine.registerBuffers(all);
+
+    Arena arena((k - 1) * bufsize + Arena::alignment * (k + m + 8));
+    SecretShare::Scheme scheme(m, k, &arena);
+    std::vector<std::span<uint8_t>> chunkOutputs;
+
+    auto chunks = bufsize ? (fsize + bufsize - 1) / bufsize : 0;
+    auto chunkLength = [&](std::uintmax_t n) {
+      return static_cast<std::size_t>(std::min<std::uintmax_t>(bufsize, fsize - n * bufsize));
+    };
+
+    if (chunks) {
+      engine.read(input.get(), inputs[0].first(chunkLength(0)), 0);
+      engine.wait();
+    }
+
+    for (std::uintmax_t n = 0; n < chunks; n++) {
+      auto b = n % 2;
+      auto len = chunkLength(n);
+
+      if (n + 1 < chunks)
+        engine.read(input.get(), inputs[1 - b].first(chunkLength(n + 1)), (n + 1) * bufsize);
+      engine.submit();
+
+      chunkOutputs.clear();
+      for (auto &o : outputs[b]) chunkOutputs.push_back(o.first(len));
+      scheme.split(inputs[b].first(len), chunkOutputs);
+      arena.reset();
+
+      // the next input has landed and the previous outputs are free again
+      engine.wait();
+      for (auto i{0u}; i < m; i++) engine.write(shares[i].get(), chunkOutputs[i], n * bufsize);
+    }
+    engine.wait();
+  }
+
+  static void joinFileAsync(const fs::path &filepath, const CommandLine::SharePaths &paths,
+                            std::uintmax_t fsize, std::size_t m, const std::set<uint> &shares) {
+    using FileOperations::FileDescriptor;
+
+    auto bufsize = static_cast<std::size_t>(std::min<std::uintmax_t>(fsize, chunkSize));
+    auto k = shares.size();
+    std::vector<FileDescriptor> inputs;
+    std::vector<uint8_t> inPoints;
+    FileDescriptor output;
+
+    try {
+      for (auto share : shares) {
+        inPoints.push_back(share);
+        inputs.emplace_back(paths.path(filepath, share), O_RDONLY);
+      }
+      output = FileDescriptor(std::format("{}.out", filepath.string()), O_WRONLY | O_CREAT | O_TRUNC);
+    } catch (const std::system_error &e) {
+      std::println("Can't open files: {} ({}: {})", e.what(), e.code().value(), e.code().message());
+      throw;
+    }
+
+    // two sets of k input buffers and two output buffers
+    Arena buffers(2 * (k + 1) * (bufsize + Arena::alignment));
+    std::array<std::vector<std::span<uint8_t>>, 2> inbufs;
+    std::array<std::span<uint8_t>, 2> outbufs;
+    std::vector<std::span<uint8_t>> all;
+    for (auto b{0u}; b < 2; b++) {
+      for (auto i{0u}; i < k; i++) {
+        inbufs[b].emplace_back(static_cast<uint8_t *>(buffers.allocate(bufsize)), bufsize);
+        all.push_back(inbufs[b].back());
+      }
+      outbufs[b] = {static_cast<uint8_t *>(buffers.allocate(bufsize)), bufsize};
+      all.push_back(outbufs[b]);
+    }
+
+    FileOperations::IoEngine engine(static_cast<unsigned>(2 * k + 2));
+    engine.registerBuffers(all);
+
+    SecretShare::Scheme scheme(m, k);
+    auto plan = scheme.joinPlan(inPoints);
+    std::vector<std::span<const uint8_t>> chunkInputs;
+
+    auto chunks = bufsize ? (fsize + bufsize - 1) / bufsize : 0;
+    auto chunkLength = [&](std::uintmax_t n) {
+      return static_cast<std::size_t>(std::min<std::uintmax_t>(bufsize, fsize - n * bufsize));
+    };
+    auto readChunk = [&](std::uintmax_t n) {
+      for (auto i{0u}; i < k; i++)
+        engine.read(inputs[i].get(), inbufs[n % 2][i].first(chunkLength(n)), n * bufsize);
+    };
+
+    if (chunks) {
+      readChunk(0);
+      engine.wait();
+    }
+
+    for (std::uintmax_t n = 0; n < chunks; n++) {
+      auto b = n % 2;
+      auto len = chunkLength(n);
+
+      if (n + 1 < chunks) readChunk(n + 1);
+      engine.submit();
+
+      chunkInputs.clear();
+      for (auto &in : inbufs[b]) chunkInputs.push_back(in.first(len));
+      scheme.join(plan, chunkInputs, outbufs[b].first(len));
+
+      engine.wait();
+      engine.write(output.get(), outbufs[b].first(len), n * bufsize);
+    }
+    engine.wait();
   }
 };  // namespace SecretShare::SecretSHareOperations
 
@@ -0,0 +1,273 @@
+#ifndef SHARECONTAINER_HPP__
+#define SHARECONTAINER_HPP__
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+#if defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+#include "ioengine.hpp"
+
+namespace SecretShare::FileOperations {
+  namespace Crc32c {
+    // slicing-by-8 tables for the reflected Castagnoli polynomial
+    inline constexpr auto tables = [] {
+      std::array<std::array<uint32_t, 256>, 8> t{};
+      for (auto i{0u}; i < 256; i++) {
+        auto c = i;
+        for (auto b{0}; b < 8; b++) c = (c >> 1) ^ (c & 1 ? 0x82f63b78u : 0);
+        t[0][i] = c;
+      }
+      for (auto i{0u}; i < 256; i++)
+        for (auto s{1u}; s < 8; s++) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+      return t;
+    }();
+  };  // namespace Crc32c
+
+  // CRC-32C of data, continuing from a previous crc. Uses the SSE4.2 crc32 instruction, eight bytes
+  // at a time, where the compiler may; table-driven otherwise
+  inline uint32_t crc32c(std::span<const uint8_t> data, uint32_t crc = 0) {
+    auto p = data.data();
+    auto n = data.size();
+    crc = ~crc;
+
+#if defined(__SSE4_2__)
+    uint64_t c = crc;
+    for (; n >= 8; p += 8, n -= 8) {
+      uint64_t v;
+      std::memcpy(&v, p, 8);
+      c = _mm_crc32_u64(c, v);
+    }
+    crc = static_cast<uint32_t>(c);
+    for (; n; p++, n--) crc = _mm_crc32_u8(crc, *p);
+#else
+    auto &t = Crc32c::tables;
+    for (; n >= 8; p += 8, n -= 8) {
+      uint32_t lo, hi;
+      std::memcpy(&lo, p, 4);
+      std::memcpy(&hi, p + 4, 4);
+      lo ^= crc;
+      crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+            t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+    for (; n; p++, n--) crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+#endif
+    return ~crc;
+  }
+
+  // The header of a share container. The container is this header followed by the share in chunks
+  // of chunkSize bytes (the last one shorter), each chunk followed by its CRC-32C. All integers are
+  // little-endian:
+  //
+  //    0  magic "SSHARE\0\x1a"     16  length      u64      40  reserved
+  //    8  version u16              24  chunkSize   u32      60  CRC-32C of bytes 0 - 59
+  //   10  share u8, m u8, k u8     28  reserved    u32
+  //   13  reserved                 32  setId       u64
+  //
+  // setId is random, chosen once per split, and tells the shares of one split from any other's.
+  struct ShareHeader {
+    static constexpr std::array<uint8_t, 8> magic{'S', 'S', 'H', 'A', 'R', 'E', 0, 0x1a};
+    static constexpr uint16_t currentVersion = 1;
+    static constexpr std::size_t size = 64;
+    static constexpr std::size_t crcSize = 4;
+
+    uint16_t version = currentVersion;
+    uint8_t share = 0;
+    uint8_t m = 0;
+    uint8_t k = 0;
+    uint64_t length = 0;
+    uint32_t chunkSize = 0;
+    uint64_t setId = 0;
+
+    uint64_t chunks() const { return chunkSize ? (length + chunkSize - 1) / chunkSize : 0; }
+    uint64_t chunkOffset(uint64_t n) const { return size + n * (chunkSize + crcSize); }
+    uint64_t fileSize() const { return size + length + chunks() * crcSize; }
+
+    std::array<uint8_t, size> encode() const {
+      std::array<uint8_t, size> b{};
+      std::memcpy(b.data(), magic.data(), magic.size());
+      put(b, 8, version, 2);
+      b[10] = share;
+      b[11] = m;
+      b[12] = k;
+      put(b, 16, length, 8);
+      put(b, 24, chunkSize, 4);
+      put(b, 32, setId, 8);
+      put(b, 60, crc32c(std::span(b).first(60)), 4);
+      return b;
+    }
+
+    // nothing if the bytes are not a container header at all; an error if they are one, but
+    // damaged or of a version this code does not know
+    static std::optional<ShareHeader> decode(std::span<const uint8_t> b) {
+      if (b.size() < size || std::memcmp(b.data(), magic.data(), magic.size())) return std::nullopt;
+      if (get(b, 60, 4) != crc32c(b.first(60)))
+        throw std::system_error(EBADMSG, std::generic_category(), "Share header fails its checksum");
+
+      ShareHeader h;
+      h.version = static_cast<uint16_t>(get(b, 8, 2));
+      if (h.version != currentVersion)
+        throw std::system_error(EPROTONOSUPPORT, std::generic_category(),
+                                std::format("Share container version {}", h.version));
+      h.share = b[10];
+      h.m = b[11];
+      h.k = b[12];
+      h.length = get(b, 16, 8);
+      h.chunkSize = static_cast<uint32_t>(get(b, 24, 4));
+      h.setId = get(b, 32, 8);
+      if (!h.chunkSize || !h.share || h.share > h.m || !h.k || h.k > h.m)
+        throw std::system_error(EBADMSG, std::generic_category(), "Share header is inconsistent");
+      return h;
+    }
+
+    static void put(std::span<uint8_t> b, std::size_t at, uint64_t v, std::size_t bytes) {
+      for (auto i{0u}; i < bytes; i++) b[at + i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+
+    static uint64_t get(std::span<const uint8_t> b, std::size_t at, std::size_t bytes) {
+      uint64_t v = 0;
+      for (auto i{0u}; i < bytes; i++) v |= static_cast<uint64_t>(b[at + i]) << (8 * i);
+      return v;
+    }
+  };
+
+  // A share on disk, raw or in a container, read and written a chunk at a time. For a raw share
+  // chunks are just consecutive runs of chunkSize bytes; a container fixes its own chunk size.
+  class ShareFile {
+   public:
+    ShareFile() = default;
+
+    // an existing share; which kind it is comes from the file itself
+    ShareFile(const std::filesystem::path &path, int flags, bool direct = false)
+        : path_(path), file_(path, flags, direct) {
+      std::array<uint8_t, ShareHeader::size> b;
+      auto size = file_.size();
+      if (size < b.size()) return;
+
+      file_.read(b, 0);
+      try {
+        header_ = ShareHeader::decode(b);
+      } catch (const std::system_error &e) {
+        throw std::system_error(e.code(), std::format("{}: {}", path.string(), e.what()));
+      }
+      if (header_ && size != header_->fileSize())
+        throw std::system_error(EBADMSG, std::generic_category(),
+                                std::format("{} is truncated or overlong", path.string()));
+    }
+
+    // a new share, in a container with the given header or raw without one
+    static ShareFile create(const std::filesystem::path &path, const std::optional<ShareHeader> &header,
+                            bool direct = false) {
+      ShareFile f;
+      f.path_ = path;
+      f.file_ = DirectFile(path, O_WRONLY | O_CREAT | O_TRUNC, direct);
+      f.header_ = header;
+      if (header) {
+        auto b = header->encode();
+        f.file_.write(b, 0);
+      }
+      return f;
+    }
+
+    bool container() const { return header_.has_value(); }
+    const std::optional<ShareHeader> &header() const { return header_; }
+    const std::filesystem::path &path() const { return path_; }
+    dev_t device() const { return file_.device(); }
+    void sync() const { file_.sync(); }
+
+    // the length of the share itself
+    uint64_t length() const { return header_ ? header_->length : file_.size(); }
+
+    // Read chunk n into payload, which holds the whole chunk. Returns the checksum stored with it in
+    // a container (for the caller to check, on whichever thread suits it), and zero for a raw share.
+    uint32_t readChunk(uint64_t n, std::size_t chunkSize, std::span<uint8_t> payload) {
+      if (header_) checkChunkSize(chunkSize);
+      return read(n * chunkSize, payload);
+    }
+
+    // Read the share from byte `position` on into payload, returning the checksum as readChunk does.
+    // A raw share can be read from anywhere; a container only a chunk at a time, so there position
+    // has to be where one of its chunks starts.
+    uint32_t read(uint64_t position, std::span<uint8_t> payload) {
+      if (!header_) {
+        file_.read(payload, position);
+        return 0;
+      }
+
+      checkChunkStart(position);
+      std::array<uint8_t, ShareHeader::crcSize> crc;
+      auto offset = header_->chunkOffset(position / header_->chunkSize);
+      file_.read(payload, offset);
+      file_.read(crc, offset + payload.size());
+      return static_cast<uint32_t>(ShareHeader::get(crc, 0, crc.size()));
+    }
+
+    // a hint that len bytes of the share from position on will be read soon
+    void willNeed(uint64_t position, uint64_t len) const {
+      if (!header_) return file_.willNeed(position, len);
+
+      auto from = header_->chunkOffset(position / header_->chunkSize);
+      auto to = header_->chunkOffset((position + len + header_->chunkSize - 1) / header_->chunkSize);
+      file_.willNeed(from, to - from);
+    }
+
+    // write chunk n, with its checksum if this is a container
+    void writeChunk(uint64_t n, std::size_t chunkSize, std::span<const uint8_t> payload, uint32_t crc) {
+      if (header_) checkChunkSize(chunkSize);
+      write(n * chunkSize, payload, crc);
+    }
+
+    // write the share from byte `position` on; like read(), a whole chunk at a time for a container
+    void write(uint64_t position, std::span<const uint8_t> payload, uint32_t crc) {
+      if (!header_) {
+        file_.write(payload, position);
+        return;
+      }
+
+      checkChunkStart(position);
+      std::array<uint8_t, ShareHeader::crcSize> b;
+      ShareHeader::put(b, 0, crc, b.size());
+      auto offset = header_->chunkOffset(position / header_->chunkSize);
+      file_.write(payload, offset);
+      file_.write(b, offset + payload.size());
+    }
+
+    // a checksum failure in chunk n, as the error to throw
+    std::system_error corrupt(uint64_t n) const {
+      return std::system_error(EBADMSG, std::generic_category(),
+                               std::format("{}: chunk {} fails its checksum", path_.string(), n));
+    }
+
+   private:
+    std::filesystem::path path_;
+    DirectFile file_;
+    std::optional<ShareHeader> header_;
+
+    void checkChunkStart(uint64_t position) const {
+      if (position % header_->chunkSize)
+        throw std::invalid_argument(
+            std::format("{}: {} is not the start of a chunk", path_.string(), position));
+    }
+
+    void checkChunkSize(std::size_t chunkSize) const {
+      if (chunkSize != header_->chunkSize)
+        throw std::invalid_argument(std::format("{} has {} byte chunks, not {}", path_.string(),
+                                                header_->chunkSize, chunkSize));
+    }
+  };
+
+  // the container header of a share, if it has one
+  inline std::optional<ShareHeader> readShareHeader(const std::filesystem::path &path) {
+    return ShareFile(path, O_RDONLY).header();
+  }
+};  // namespace SecretShare::FileOperations
+
+#endif
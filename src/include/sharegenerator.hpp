@@ -0,0 +1,105 @@
+#ifndef SHAREGENERATOR_HPP__
+#define SHAREGENERATOR_HPP__
+#include <cstdint>
+#include <ranges>
+#include <span>
+#include <vector>
+#if __has_include(<generator>)
+#include <generator>
+#endif
+
+#include "secretshare.hpp"
+
+#if defined(__cpp_lib_generator)
+namespace SecretShare {
+  // One chunk of one share. share is the share index, counting from 1, or 0 for the secret itself;
+  // offset is where the chunk sits in the whole share. data is only valid until the generator is
+  // resumed, since the buffers behind it are reused for the next chunk.
+  struct ShareChunk {
+    std::size_t share;
+    std::size_t offset;
+    std::span<const uint8_t> data;
+  };
+
+  namespace Generators {
+    // grows a set of scheme-owned buffers to hold the largest chunk seen so far
+    class ChunkBuffers {
+     public:
+      ChunkBuffers(Scheme &scheme, std::size_t count) : scheme_(scheme), buffers_(count) {}
+      ChunkBuffers(const ChunkBuffers &) = delete;
+      ChunkBuffers &operator=(const ChunkBuffers &) = delete;
+      ~ChunkBuffers() { release(); }
+
+      std::span<const std::span<uint8_t>> get(std::size_t len) {
+        if (len > capacity_) {
+          release();
+          for (auto &b : buffers_) b = scheme_.allocate(len);
+          capacity_ = len;
+        }
+        views_.clear();
+        for (auto &b : buffers_) views_.push_back(b.first(len));
+        return views_;
+      }
+
+     private:
+      Scheme &scheme_;
+      std::vector<std::span<uint8_t>> buffers_;
+      std::vector<std::span<uint8_t>> views_;
+      std::size_t capacity_ = 0;
+
+      void release() {
+        if (capacity_)
+          for (auto &b : buffers_) scheme_.deallocate(b);
+        capacity_ = 0;
+      }
+    };
+  };  // namespace Generators
+
+  // Split a secret that arrives as a range of chunks, yielding the m share chunks for each input
+  // chunk as soon as they are computed. Nothing more is read until every chunk has been consumed,
+  // so a slow consumer holds up the producer and memory stays at m buffers of the largest chunk.
+  // The scheme must outlive the generator; pass containers by std::views::all or std::ref_view.
+  template <std::ranges::input_range R>
+    requires std::convertible_to<std::ranges::range_reference_t<R>, std::span<const uint8_t>>
+  std::generator<ShareChunk> splitChunks(Scheme &scheme, R input) {
+    Generators::ChunkBuffers buffers(scheme, scheme.m());
+    std::size_t offset = 0;
+
+    for (auto &&item : input) {
+      std::span<const uint8_t> chunk = item;
+      auto outputs = buffers.get(chunk.size());
+      scheme.split(chunk, outputs);
+
+      for (auto i{0u}; i < outputs.size(); i++) co_yield ShareChunk{i + 1, offset, outputs[i]};
+      offset += chunk.size();
+    }
+  }
+
+  // Join shares that arrive as a range of chunk sets, one chunk of the same length from each of the
+  // shares at inPoints, in that order. Yields each chunk of the secret, with share index 0, as soon
+  // as it is reconstructed.
+  template <std::ranges::input_range R>
+    requires std::convertible_to<std::ranges::range_reference_t<R>,
+                                 std::span<const std::span<const uint8_t>>>
+  std::generator<ShareChunk> joinChunks(Scheme &scheme, std::vector<uint8_t> inPoints, R input) {
+    Generators::ChunkBuffers buffers(scheme, 1);
+    auto plan = scheme.joinPlan(inPoints);
+    std::size_t offset = 0;
+
+    for (auto &&item : input) {
+      std::span<const std::span<const uint8_t>> chunks = item;
+      if (chunks.size() != inPoints.size())
+        throw std::invalid_argument("Chunk set does not match share list");
+
+      auto len = chunks.empty() ? 0 : chunks[0].size();
+      auto output = buffers.get(len)[0];
+      scheme.join(plan, chunks, output);
+
+      co_yield ShareChunk{0, offset, output};
+      offset += len;
+    }
+  }
+};  // namespace SecretShare
+#endif
+
+#endif